@@ -55,7 +55,7 @@
 
 // Vulkan includes
 #ifdef IMGUI_IMPL_VULKAN_USE_VOLK
-#include <Volk/volk.h>
+#include <volk/volk.h>
 #else
 #include <vulkan/vulkan.h>
 #endif
@@ -0,0 +1,33 @@
+#ifndef BINDLESS_GLSL
+#define BINDLESS_GLSL
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Global heap, see DescriptorBufferBindless. Define BINDLESS_SET before including to move it off set 0.
+#ifndef BINDLESS_SET
+#define BINDLESS_SET 0
+#endif
+
+layout(set = BINDLESS_SET, binding = 0) uniform sampler bindlessSamplers[];
+layout(set = BINDLESS_SET, binding = 1) writeonly uniform image2D bindlessStorageImages[];
+// variable-count, sized to the heap's capacity
+layout(set = BINDLESS_SET, binding = 2) uniform texture2D bindlessTextures[];
+
+// indices may differ between invocations (e.g. per material), so they are always marked nonuniform
+vec4 sample_bindless(uint textureIndex, uint samplerIndex, vec2 uv) {
+    return texture(sampler2D(bindlessTextures[nonuniformEXT(textureIndex)], bindlessSamplers[nonuniformEXT(samplerIndex)]), uv);
+}
+
+vec4 sample_bindless_lod(uint textureIndex, uint samplerIndex, vec2 uv, float lod) {
+    return textureLod(sampler2D(bindlessTextures[nonuniformEXT(textureIndex)], bindlessSamplers[nonuniformEXT(samplerIndex)]), uv, lod);
+}
+
+ivec2 bindless_texture_size(uint textureIndex) {
+    return textureSize(bindlessTextures[nonuniformEXT(textureIndex)], 0);
+}
+
+void store_bindless(uint imageIndex, ivec2 texel, vec4 value) {
+    imageStore(bindlessStorageImages[nonuniformEXT(imageIndex)], texel, value);
+}
+
+#endif
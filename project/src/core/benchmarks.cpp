@@ -0,0 +1,273 @@
+#include "benchmarks.h"
+#include "engine.h"
+#include "vk_deletion_queue.h"
+#include "vk_descriptor_buffer.h"
+
+namespace {
+	using Clock = std::chrono::high_resolution_clock;
+
+	double elapsed_ms(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	template<typename T>
+	T fake_handle(uint64_t value) { return reinterpret_cast<T>(static_cast<uintptr_t>(value)); }
+
+	// stands in for the vkDestroy* calls, so both queues do the same work per handle and nothing is optimized away
+	struct DestroySink {
+		uint64_t checksum{ 0 };
+		void destroy(const void* handle) { checksum += reinterpret_cast<uintptr_t>(handle); }
+	};
+
+	struct SinkVisitor {
+		DestroySink& sink;
+		template<typename... Handles>
+		void operator()(Handles... handles) { (sink.destroy(handles), ...); }
+	};
+
+	// DescriptorBuffer's free list before DescriptorSlotAllocator
+	struct VectorFreeList {
+		std::vector<int> free_indices;
+
+		void init(int capacity) { for (int i = 0; i < capacity; i++) { free_indices.push_back(i); } }
+		int allocate() {
+			int index = free_indices[0];
+			free_indices.erase(free_indices.begin());
+			return index;
+		}
+		void claim(int index) {
+			for (int i = 0; i < free_indices.size(); i++) {
+				if (free_indices[i] == index) {
+					free_indices.erase(free_indices.begin() + i);
+					break;
+				}
+			}
+		}
+		void free(int index) { free_indices.push_back(index); }
+	};
+
+	// runs the same churn against either free list, returns the ms spent allocating and claiming
+	template<typename FreeList>
+	std::pair<double, double> churn_slots(FreeList& freeList, uint32_t cycles, int capacity, uint64_t& checksum)
+	{
+		freeList.init(capacity);
+		// half full, so both free lists have a long tail of free slots
+		std::vector<int> live;
+		for (int i = 0; i < capacity / 2; i++) { live.push_back(freeList.allocate()); }
+
+		uint32_t state = 12345;
+		auto next_random = [&](size_t count) {
+			state = state * 1664525u + 1013904223u;
+			return static_cast<size_t>(state >> 8) % count;
+		};
+		auto next_live = [&]() { return next_random(live.size()); };
+
+		Clock::time_point start = Clock::now();
+		for (uint32_t i = 0; i < cycles; i++) {
+			size_t slot = next_live();
+			freeList.free(live[slot]);
+			live[slot] = freeList.allocate();
+			checksum += live[slot];
+		}
+		double allocateMs = elapsed_ms(start);
+
+		// claims a random free slot rather than the one just freed, which would always sit on top of the stack
+		std::vector<bool> isLive(capacity, false);
+		for (int index : live) { isLive[index] = true; }
+		std::vector<int> freeSlots;
+		for (int index = 0; index < capacity; index++) {
+			if (!isLive[index]) { freeSlots.push_back(index); }
+		}
+
+		start = Clock::now();
+		for (uint32_t i = 0; i < cycles; i++) {
+			size_t slot = next_live();
+			size_t freeSlot = next_random(freeSlots.size());
+			int claimed = freeSlots[freeSlot];
+			freeList.free(live[slot]);
+			freeList.claim(claimed);
+			freeSlots[freeSlot] = live[slot];
+			live[slot] = claimed;
+			checksum += claimed;
+		}
+		double claimMs = elapsed_ms(start);
+
+		return { allocateMs, claimMs };
+	}
+}
+
+void benchmarks::run_all()
+{
+	run_deletion_queue(120);
+	run_descriptor_slots();
+}
+
+void benchmarks::run_deletion_queue(uint32_t frames, uint32_t pushesPerFrame)
+{
+	DestroySink functionSink;
+	DestroySink typedSink;
+	double functionPush{ 0 }, functionFlush{ 0 };
+	double typedPush{ 0 }, typedFlush{ 0 };
+
+	DeletionQueue functionQueue;
+	ResourceDeletionQueue typedQueue;
+
+	// the same mix for both queues: a view + image pair, a buffer and a sampler every four pushes
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		Clock::time_point start = Clock::now();
+		for (uint32_t i = 0; i < pushesPerFrame; i++) {
+			uint64_t handle = static_cast<uint64_t>(i) + 1;
+			switch (i % 4) {
+			case 0: {
+				VkImageView view = fake_handle<VkImageView>(handle);
+				functionQueue.push_function([&functionSink, view]() { functionSink.destroy(view); });
+				break;
+			}
+			case 1: {
+				VkImage image = fake_handle<VkImage>(handle);
+				VmaAllocation allocation = fake_handle<VmaAllocation>(handle);
+				functionQueue.push_function([&functionSink, image, allocation]() { functionSink.destroy(image); functionSink.destroy(allocation); });
+				break;
+			}
+			case 2: {
+				VkBuffer buffer = fake_handle<VkBuffer>(handle);
+				VmaAllocation allocation = fake_handle<VmaAllocation>(handle);
+				functionQueue.push_function([&functionSink, buffer, allocation]() { functionSink.destroy(buffer); functionSink.destroy(allocation); });
+				break;
+			}
+			default: {
+				VkSampler sampler = fake_handle<VkSampler>(handle);
+				functionQueue.push_function([&functionSink, sampler]() { functionSink.destroy(sampler); });
+				break;
+			}
+			}
+		}
+		functionPush += elapsed_ms(start);
+
+		start = Clock::now();
+		functionQueue.flush();
+		functionFlush += elapsed_ms(start);
+
+		start = Clock::now();
+		for (uint32_t i = 0; i < pushesPerFrame; i++) {
+			uint64_t handle = static_cast<uint64_t>(i) + 1;
+			switch (i % 4) {
+			case 0: typedQueue.push(fake_handle<VkImageView>(handle)); break;
+			case 1: typedQueue.push(AllocatedImage{ fake_handle<VkImage>(handle), VK_NULL_HANDLE, fake_handle<VmaAllocation>(handle) }); break;
+			case 2: typedQueue.push(AllocatedBuffer{ fake_handle<VkBuffer>(handle), fake_handle<VmaAllocation>(handle) }); break;
+			default: typedQueue.push(fake_handle<VkSampler>(handle)); break;
+			}
+		}
+		typedPush += elapsed_ms(start);
+
+		start = Clock::now();
+		typedQueue.drain(SinkVisitor{ typedSink });
+		typedFlush += elapsed_ms(start);
+	}
+
+	if (functionSink.checksum != typedSink.checksum) {
+		fmt::print("Deletion queue benchmark: checksum mismatch ({} vs {})\n", functionSink.checksum, typedSink.checksum);
+	}
+
+	fmt::print("Deletion queue, {} frames x {} pushes (ms per frame)\n", frames, pushesPerFrame);
+	fmt::print("  std::function  push {:8.3f}  flush {:8.3f}  total {:8.3f}\n"
+		, functionPush / frames, functionFlush / frames, (functionPush + functionFlush) / frames);
+	fmt::print("  typed          push {:8.3f}  flush {:8.3f}  total {:8.3f}\n"
+		, typedPush / frames, typedFlush / frames, (typedPush + typedFlush) / frames);
+}
+
+void benchmarks::run_descriptor_slots(uint32_t cycles, int capacity)
+{
+	uint64_t vectorChecksum{ 0 };
+	uint64_t slotChecksum{ 0 };
+	VectorFreeList vectorFreeList;
+	DescriptorSlotAllocator slotAllocator;
+	auto [vectorAllocate, vectorClaim] = churn_slots(vectorFreeList, cycles, capacity, vectorChecksum);
+	auto [slotAllocate, slotClaim] = churn_slots(slotAllocator, cycles, capacity, slotChecksum);
+
+	fmt::print("Descriptor slots, {} cycles, {} slots half full (ms)\n", cycles, capacity);
+	fmt::print("  std::vector<int>         free+allocate {:8.3f}  free+claim {:8.3f}\n", vectorAllocate, vectorClaim);
+	fmt::print("  DescriptorSlotAllocator  free+allocate {:8.3f}  free+claim {:8.3f}\n", slotAllocate, slotClaim);
+	// the checksums differ (FIFO against LIFO reuse), they only keep the loops from being optimized away
+	if (vectorChecksum == 0 || slotChecksum == 0) { fmt::print("  empty churn\n"); }
+}
+
+void benchmarks::run_buffer_upload(UploadManager& uploadManager, VmaAllocator allocator, uint32_t bufferCount, VkDeviceSize bufferSize)
+{
+	std::vector<uint8_t> payload(static_cast<size_t>(bufferSize));
+	std::iota(payload.begin(), payload.end(), static_cast<uint8_t>(0));
+
+	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.size = bufferSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	std::vector<AllocatedBuffer> buffers(bufferCount);
+	// allocation isn't timed, returns how many buffers the host can write to
+	auto create_buffers = [&](const VmaAllocationCreateInfo& allocInfo) {
+		uint32_t hostVisibleCount{ 0 };
+		for (AllocatedBuffer& buffer : buffers) {
+			VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, &buffer.info));
+			VkMemoryPropertyFlags memoryFlags;
+			vmaGetAllocationMemoryProperties(allocator, buffer.allocation, &memoryFlags);
+			if (memoryFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) { hostVisibleCount++; }
+		}
+		return hostVisibleCount;
+	};
+	// the uploads have completed, but with a dedicated transfer queue the first frame would still acquire the buffers
+	auto destroy_buffers = [&]() {
+		for (AllocatedBuffer& buffer : buffers) {
+			uploadManager.discard_acquires(buffer.buffer);
+			vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+		}
+	};
+	// the engine's upload path for both sides: UploadBatch writes host visible buffers directly and stages the rest through the ring.
+	//  batches are kept to half the ring so the next one is staged while the previous one copies
+	uint32_t buffersPerBatch = static_cast<uint32_t>(std::max<VkDeviceSize>(UploadManager::STAGING_RING_SIZE / 2 / bufferSize, 1));
+	auto upload_buffers = [&]() {
+		Clock::time_point start = Clock::now();
+		UploadTicket last{ 0 };
+		for (uint32_t first = 0; first < bufferCount; first += buffersPerBatch) {
+			UploadBatch batch(uploadManager);
+			for (uint32_t i = first; i < std::min(first + buffersPerBatch, bufferCount); i++) {
+				batch.upload_buffer(buffers[i], payload.data(), payload.size());
+			}
+			last = std::max(last, batch.submit());
+		}
+		if (last != 0) { uploadManager.wait(last); }
+		return elapsed_ms(start);
+	};
+
+	double bufferMB = bufferSize / (1024.0 * 1024.0);
+	double totalMB = bufferCount * bufferMB;
+	fmt::print("Buffer upload, {} x {:.1f} MB\n", bufferCount, bufferMB);
+
+	// staged: GPU_ONLY buffers, how device local buffers were uploaded before direct writes
+	VmaAllocationCreateInfo deviceInfo = {};
+	deviceInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	uint32_t stagedCount = bufferCount - create_buffers(deviceInfo);
+	double stagedMs = upload_buffers();
+	destroy_buffers();
+	double stagedMB = stagedCount * bufferMB;
+	fmt::print("  staged  {:8.3f} ms  {:8.1f} MB/s  {:.1f} MB copied on the GPU\n", stagedMs, totalMB / (stagedMs / 1000.0), stagedMB);
+	if (stagedCount < bufferCount) {
+		fmt::print("          {} of {} GPU_ONLY buffers are host visible (unified memory) and were written directly\n", bufferCount - stagedCount, bufferCount);
+	}
+
+	if (!uploadManager.supports_direct_upload()) {
+		fmt::print("  direct  skipped, no host visible device local heap larger than {} MB\n", UploadManager::LEGACY_BAR_SIZE / (1024 * 1024));
+		return;
+	}
+
+	// direct: buffers VMA may place in host visible VRAM, written by the host with nothing to submit
+	VmaAllocationCreateInfo directInfo = {};
+	directInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+	directInfo.flags = uploadManager.get_device_buffer_flags();
+	uint32_t directCount = create_buffers(directInfo);
+	double directMs = upload_buffers();
+	destroy_buffers();
+	double directStagedMB = (bufferCount - directCount) * bufferMB;
+	fmt::print("  direct  {:8.3f} ms  {:8.1f} MB/s  {:.1f} MB copied on the GPU, {} of {} buffers written directly\n"
+		, directMs, totalMB / (directMs / 1000.0), directStagedMB, directCount, bufferCount);
+	fmt::print("  saved   {:8.3f} ms  {:.1f} MB of staging copies\n", stagedMs - directMs, stagedMB - directStagedMB);
+}
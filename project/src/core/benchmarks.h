@@ -0,0 +1,21 @@
+#pragma once
+#include "big_header.h"
+#include "vk_upload_manager.h"
+
+// Microbenchmarks for engine internals.
+//  The CPU ones run with --benchmark instead of starting the engine and feed the measured code fake handles,
+//  the GPU ones run after initialization on the engine's device.
+namespace benchmarks {
+	void run_all();
+
+	// std::function DeletionQueue against ResourceDeletionQueue, pushing and flushing pushesPerFrame handles per frame
+	void run_deletion_queue(uint32_t frames, uint32_t pushesPerFrame = 100000);
+
+	// descriptor buffer slot churn: the old std::vector<int> free list against DescriptorSlotAllocator.
+	//  each cycle frees a live slot and allocates one (setup_data), or frees one and claims a random free slot by index (set_data)
+	void run_descriptor_slots(uint32_t cycles = 100000, int capacity = 4096);
+
+	// staging copy into device local buffers against writing them directly, run with --benchmark-uploads.
+	//  the direct side is skipped if the device has no host visible VRAM to place the buffers in
+	void run_buffer_upload(UploadManager& uploadManager, VmaAllocator allocator, uint32_t bufferCount = 64, VkDeviceSize bufferSize = 4 * 1024 * 1024);
+}
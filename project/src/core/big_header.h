@@ -15,6 +15,11 @@
 #include <thread>
 #include <unordered_map>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <ranges>
+#include <type_traits>
 // vulkan
 #define VK_NO_PROTOTYPES
 #include <vulkan/vulkan.h>
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <engine.h>
+#include <benchmarks.h>
 
 // defined here because needs implementation in translation unit
 #define STB_IMAGE_IMPLEMENTATION
@@ -19,13 +20,26 @@
 #define ENABLE_FRAME_STATISTICS true
 #define USE_MSAA false
 #define MSAA_SAMPLES VK_SAMPLE_COUNT_1_BIT
+// frames between fragmentation checks, vmaCalculateStatistics walks every allocation
+#define DEFRAGMENTATION_CHECK_INTERVAL 600
+
+// order of the passes that use the draw images within a frame, draw images only share memory if their phases don't overlap.
+//  the current passes keep every draw image alive through RESOLVE, so nothing shares memory until passes after it add images
+enum DrawPhase : uint32_t {
+	DRAW_PHASE_GEOMETRY,
+	DRAW_PHASE_RESOLVE,
+	DRAW_PHASE_OUTPUT,
+};
 
 void MainEngine::init() {
 	fmt::print("================================================================================\n");
 	fmt::print("Initializing Program\n");
 	auto start = std::chrono::system_clock::now();
 
-	{
+	_frameOverlap = std::clamp(_frameOverlap, 1u, MAX_FRAME_OVERLAP);
+
+	// headless has no window, surface or swapchain. Frames are rendered into _drawImage only
+	if (!_headless) {
 		// We initialize SDL and create a window with it.
 		SDL_Init(SDL_INIT_VIDEO);
 		SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
@@ -43,28 +57,71 @@ void MainEngine::init() {
 	init_swapchain();
 	init_commands();
 	init_sync_structures();
+	init_frame_allocators();
 
 	init_default_data();
+	init_bindless();
 
-	init_dearimgui();
+	if (!_headless) { init_dearimgui(); }
 
 	init_pipeline();
 
+	if (_runUploadBenchmark) { benchmarks::run_buffer_upload(_uploadManager, _allocator); }
+
 	auto end = std::chrono::system_clock::now();
 	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 	fmt::print("Finished Initialization in {} seconds\n", elapsed.count() / 1000000.0f);
 	fmt::print("================================================================================\n");
 }
 
+static bool is_input_event(const SDL_Event& e) {
+	switch (e.type) {
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+	case SDL_TEXTINPUT:
+	case SDL_MOUSEMOTION:
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+	case SDL_MOUSEWHEEL:
+	case SDL_CONTROLLERAXISMOTION:
+	case SDL_CONTROLLERBUTTONDOWN:
+	case SDL_CONTROLLERBUTTONUP:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void MainEngine::request_stop()
+{
+	_stopRequested = true;
+}
+
 void MainEngine::run() {
+	if (_headless) {
+		run_headless();
+		return;
+	}
+
 	SDL_Event e;
 	bool bQuit = false;
 	bool stop_rendering = false;
 	SDL_SetRelativeMouseMode(SDL_FALSE);
 
-	while (!bQuit) {
+	while (!bQuit && !_stopRequested) {
+		if (_lowLatencyMode && !stop_rendering) {
+			wait_for_frame_limit();
+			// block on the frame slot here instead of in draw() so input is sampled as late as possible
+			wait_for_frame_retired(get_current_frame()._timelineValue);
+		}
+
 		while (SDL_PollEvent(&e)) {
 			if (e.type == SDL_QUIT) { bQuit = true; continue; }
+			if (is_input_event(e) && _pendingInputCounter == 0) {
+				// event timestamps are SDL_GetTicks() milliseconds, rebase onto the performance counter
+				uint64_t eventAge = static_cast<uint64_t>(SDL_GetTicks() - e.common.timestamp);
+				_pendingInputCounter = SDL_GetPerformanceCounter() - eventAge * SDL_GetPerformanceFrequency() / 1000;
+			}
 			if (e.type == SDL_WINDOWEVENT) {
 				if (e.window.event == SDL_WINDOWEVENT_MINIMIZED) {
 					stop_rendering = true;
@@ -72,6 +129,9 @@ void MainEngine::run() {
 				if (e.window.event == SDL_WINDOWEVENT_RESTORED) {
 					stop_rendering = false;
 				}
+				if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+					resize_requested = true;
+				}
 			}
 
 			ImGui_ImplSDL2_ProcessEvent(&e);
@@ -87,104 +147,290 @@ void MainEngine::run() {
 
 		// actual rendering
 		draw();
+
+		if (!_lowLatencyMode) { wait_for_frame_limit(); }
 	}
 }
 
+void MainEngine::run_headless()
+{
+	fmt::print("Running headless at {}x{}", _windowExtent.width, _windowExtent.height);
+	if (_headlessFrameCount > 0) { fmt::print(" for {} frames", _headlessFrameCount); }
+	fmt::print("\n");
+
+	auto start = std::chrono::steady_clock::now();
+	uint32_t framesRendered = 0;
+	while (!_stopRequested && (_headlessFrameCount == 0 || framesRendered < _headlessFrameCount)) {
+		draw();
+		wait_for_frame_limit();
+		framesRendered++;
+	}
+	if (_frameNumber > 0) { wait_for_frame_retired(get_frame_timeline_value(_frameNumber - 1)); }
 
-void MainEngine::draw()
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	fmt::print("Rendered {} frames in {} seconds ({} ms/frame)\n", framesRendered, elapsed
+		, framesRendered > 0 ? elapsed * 1000.0 / framesRendered : 0.0);
+}
+
+void MainEngine::wait_for_frame_limit()
 {
-	auto start = std::chrono::system_clock::now();
+	auto now = std::chrono::steady_clock::now();
+	if (_targetFrameRate <= 0.0f) {
+		_nextFrameDeadline = now;
+		return;
+	}
 
+	auto frameDuration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1.0 / _targetFrameRate));
+	// fell behind by more than a frame (or first limited frame), don't try to catch up
+	if (now - _nextFrameDeadline > frameDuration) { _nextFrameDeadline = now; }
 
-	// GPU -> CPU sync (fence)
-	VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._renderFence, true, 1000000000));
-	get_current_frame()._deletionQueue.flush();
-	VK_CHECK(vkResetFences(_device, 1, &get_current_frame()._renderFence));
+	// sleep is only accurate to the scheduler granularity, so stop short and spin the remainder
+	constexpr auto spinMargin = std::chrono::microseconds(1500);
+	if (_nextFrameDeadline - now > spinMargin) {
+		std::this_thread::sleep_for(_nextFrameDeadline - now - spinMargin);
+	}
+	while (std::chrono::steady_clock::now() < _nextFrameDeadline) {
+		std::this_thread::yield();
+	}
+
+	_nextFrameDeadline += frameDuration;
+}
+
+
+void MainEngine::draw()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	apply_frame_overlap();
+
+	// GPU -> CPU sync (timeline semaphore)
+	wait_for_frame_retired(get_current_frame()._timelineValue);
+	if (get_current_frame()._deletionQueue.has_views_or_samplers()) { invalidate_descriptor_caches(); }
+	get_current_frame()._deletionQueue.flush(_device, _allocator);
+	get_current_frame()._frameAllocator.reset();
+	// descriptor buffers that grew since the last frame, frames still in flight may have the old ones bound
+	_fullscreenDescriptorBuffer.retire_previous_buffers(get_current_frame()._deletionQueue);
+
+	// recreate after the flush so the old swapchain is retired with this frame, not destroyed by it
+	if (resize_requested) {
+		resize_swapchain();
+		if (resize_requested) { return; }
+	}
+
+	// refreshes VMA's cached budget
+	vmaSetCurrentFrameIndex(_allocator, static_cast<uint32_t>(_frameNumber));
 
 	// GPU -> GPU sync (semaphore)
-	uint32_t swapchainImageIndex;
-	VkResult e = vkAcquireNextImageKHR(_device, _swapchain, 1000000000, get_current_frame()._swapchainSemaphore, nullptr, &swapchainImageIndex);
-	//if (e == VK_ERROR_OUT_OF_DATE_KHR) { resize_requested = true; fmt::print("Swapchain out of date, resize requested\n"); return; }
+	uint32_t swapchainImageIndex{ 0 };
+	if (!_headless) {
+		VkResult e = vkAcquireNextImageKHR(_device, _swapchain, 1000000000, get_current_frame()._swapchainSemaphore, nullptr, &swapchainImageIndex);
+		if (e == VK_ERROR_OUT_OF_DATE_KHR) { resize_requested = true; fmt::print("Swapchain out of date, resize requested\n"); return; }
+		if (e == VK_SUBOPTIMAL_KHR) { resize_requested = true; }
+		else if (e != VK_SUCCESS) { VK_CHECK(e); }
+	}
+
+	auto acquireEnd = std::chrono::steady_clock::now();
 
 	VkCommandBuffer cmd = get_current_frame()._mainCommandBuffer;
 	VK_CHECK(vkResetCommandBuffer(cmd, 0));
 	VkCommandBufferBeginInfo cmdBeginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT); // only submit once
 
-	_drawExtent.height = static_cast<uint32_t>(std::min(_swapchainExtent.height, _drawImage.imageExtent.height) * _renderScale);
-	_drawExtent.width = static_cast<uint32_t>(std::min(_swapchainExtent.width, _drawImage.imageExtent.width) * _renderScale);
-
-	VkClearColorValue clearColor = { 0.1f, 0.1f, 0.1f, 1.0f };
-	VkImageSubresourceRange subresourceRange = vkinit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+	// headless renders at the requested window size
+	VkExtent2D targetExtent = _headless ? _windowExtent : _swapchainExtent;
+	VkExtent3D drawImageExtent = _resources.get_image_extent(_drawImage);
+	_drawExtent.height = static_cast<uint32_t>(std::min(targetExtent.height, drawImageExtent.height) * _renderScale);
+	_drawExtent.width = static_cast<uint32_t>(std::min(targetExtent.width, drawImageExtent.width) * _renderScale);
 
-	auto start2 = std::chrono::system_clock::now();
+	auto start2 = std::chrono::steady_clock::now();
 
 	VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
-	vkutil::transition_image(cmd, _drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-	draw_fullscreen(cmd, _errorCheckerboardImage, _drawImage);
+	// this frame slot has retired, so the profiler can read its previous timestamps
+	_gpuProfiler.begin_frame(_device, cmd, _frameNumber % _frameOverlap);
+	uint64_t uploadWaitValue{ 0 };
+	{
+		ScopedGpuTimer frameTimer(_gpuProfiler, cmd, "frame");
 
-	vkutil::transition_image(cmd, _drawImage.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-	vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	vkutil::copy_image_to_image(cmd, _drawImage.image, _swapchainImages[swapchainImageIndex], _drawExtent, _swapchainExtent);
+		// take ownership of finished uploads before anything samples them
+		uploadWaitValue = _uploadManager.record_acquires(cmd);
 
-	//vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	//vkCmdClearColorImage(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &subresourceRange);
-	vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-	draw_imgui(cmd, _swapchainImageViews[swapchainImageIndex]);
-	vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		// a bounded number of moves per frame, copied before this frame's passes use the resources
+		if (_autoDefragment && _frameNumber % DEFRAGMENTATION_CHECK_INTERVAL == 0
+			&& !_defragmenter.is_running() && _defragmenter.should_defragment()) {
+			_defragmenter.begin();
+		}
+		_defragmenter.update(cmd, get_frame_timeline_value(_frameNumber), get_retired_frame_value(), !_uploadManager.has_pending_acquires()
+			, get_current_frame()._deletionQueue);
+		// the heap keeps the old views until every frame from before the move has retired, frames still on the queue
+		//  can sample either view then. the old ones are destroyed once this frame retires
+		for (ImageHandle copied : _defragmenter.get_copied_images()) {
+			if (_resources.is_valid(copied) && get_bindless_index(copied) != DescriptorBufferBindless::INVALID_INDEX) {
+				_bindlessHeap.update_sampled_image(_device, copied.index(), _resources.get_image_view(copied));
+			}
+		}
+		if (_defragmenter.destroyed_image_views()) { invalidate_descriptor_caches(); }
+
+		_renderGraph.reset();
+		// contents are discarded every frame, but the previous frame may still be drawing to or blitting from it.
+		//  it shares memory with no other draw image, so nothing else has to be waited on
+		RenderGraphImage drawImage = _renderGraph.import_image("draw", _resources.get_image(_drawImage), VK_IMAGE_ASPECT_COLOR_BIT
+			, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT);
+
+		_renderGraph.add_pass("draw_fullscreen", [&](VkCommandBuffer passCmd) {
+			draw_fullscreen(passCmd, _errorCheckerboardImage, _drawImage);
+			})
+			.write(drawImage, ImageUsage::ColorAttachment);
+
+		if (!_headless) {
+			// the acquire semaphore is waited on at COLOR_ATTACHMENT_OUTPUT, the first barrier chains onto it
+			RenderGraphImage swapchainImage = _renderGraph.import_image("swapchain", _swapchainImages[swapchainImageIndex]
+				, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+			_renderGraph.export_image(swapchainImage, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+			_renderGraph.add_pass("swapchain_blit", [&](VkCommandBuffer passCmd) {
+				vkutil::copy_image_to_image(passCmd, _resources.get_image(_drawImage), _swapchainImages[swapchainImageIndex], _drawExtent, _swapchainExtent);
+				})
+				.read(drawImage, ImageUsage::TransferSrc)
+				.write(swapchainImage, ImageUsage::TransferDst);
+
+			_renderGraph.add_pass("draw_imgui", [&](VkCommandBuffer passCmd) {
+				draw_imgui(passCmd, _swapchainImageViews[swapchainImageIndex]);
+				})
+				.write(swapchainImage, ImageUsage::ColorAttachment);
+		}
+		else {
+			// headless output stays readable for readbacks
+			_renderGraph.export_image(drawImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		}
+
+		_renderGraph.compile();
+		_renderGraph.execute(cmd, &_gpuProfiler);
+	}
 
 	VK_CHECK(vkEndCommandBuffer(cmd));
 
-	auto end2 = std::chrono::system_clock::now();
+	auto end2 = std::chrono::steady_clock::now();
 	auto elapsed2 = std::chrono::duration_cast<std::chrono::microseconds>(end2 - start2);
 
 	// Submission
+	uint64_t frameValue = get_frame_timeline_value(_frameNumber);
 	VkCommandBufferSubmitInfo cmdinfo = vkinit::command_buffer_submit_info(cmd);
-	VkSemaphoreSubmitInfo waitInfo = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, get_current_frame()._swapchainSemaphore);
-	VkSemaphoreSubmitInfo signalInfo = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT_KHR, get_current_frame()._renderSemaphore);
-	VkSubmitInfo2 submit = vkinit::submit_info(&cmdinfo, &signalInfo, &waitInfo);
-	VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit, get_current_frame()._renderFence)); // when cmd is no longer used, fence is signaled and next command can be recorded/queued
-	// Present
-	VkPresentInfoKHR presentInfo = {};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.pNext = nullptr;
-	presentInfo.pSwapchains = &_swapchain;
-	presentInfo.swapchainCount = 1;
-	presentInfo.pWaitSemaphores = &get_current_frame()._renderSemaphore;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pImageIndices = &swapchainImageIndex;
-	VkResult presentResult = vkQueuePresentKHR(_graphicsQueue, &presentInfo);
-
-	/*if (presentResult == VK_ERROR_OUT_OF_DATE_KHR) {
-		resize_requested = true;
-		fmt::print("present failed - out of date, resize requested\n");
-	}*/
+	VkSemaphoreSubmitInfo waitInfos[2];
+	uint32_t waitCount = 0;
+	// headless has no swapchain image to wait on or present semaphore to signal
+	if (!_headless) {
+		waitInfos[waitCount++] = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, get_current_frame()._swapchainSemaphore);
+	}
+	if (uploadWaitValue != 0) {
+		// already reached on the host, only makes the acquired uploads visible to this submission
+		waitInfos[waitCount++] = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _uploadManager.get_timeline(), uploadWaitValue);
+	}
+	VkSemaphoreSubmitInfo signalInfos[2] = {
+		// when cmd is no longer used, timeline reaches frameValue and this frame's resources can be reused
+		vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _frameTimeline, frameValue),
+		vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT_KHR, get_current_frame()._renderSemaphore),
+	};
+	VkSubmitInfo2 submit = vkinit::submit_info(&cmdinfo, signalInfos, waitCount > 0 ? waitInfos : nullptr);
+	submit.waitSemaphoreInfoCount = waitCount;
+	submit.signalSemaphoreInfoCount = _headless ? 1 : 2;
+	VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit, VK_NULL_HANDLE));
+	get_current_frame()._timelineValue = frameValue;
+
+	auto submitEnd = std::chrono::steady_clock::now();
+
+	if (!_headless) {
+		// Present
+		VkPresentInfoKHR presentInfo = {};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.pNext = nullptr;
+		presentInfo.pSwapchains = &_swapchain;
+		presentInfo.swapchainCount = 1;
+		presentInfo.pWaitSemaphores = &get_current_frame()._renderSemaphore;
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pImageIndices = &swapchainImageIndex;
+		VkResult presentResult = vkQueuePresentKHR(_graphicsQueue, &presentInfo);
+
+		if (_pendingInputCounter != 0) {
+			uint64_t elapsedCounter = SDL_GetPerformanceCounter() - _pendingInputCounter;
+			inputLatency = static_cast<float>(elapsedCounter * 1000.0 / SDL_GetPerformanceFrequency());
+			averageInputLatency = averageInputLatency == 0.0f ? inputLatency : averageInputLatency * 0.9f + inputLatency * 0.1f;
+			_pendingInputCounter = 0;
+		}
 
-	//increase the number of frames drawn
-	_frameNumber++;
+		if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR) {
+			resize_requested = true;
+			fmt::print("present failed - out of date, resize requested\n");
+		}
+	}
 
-	auto end = std::chrono::system_clock::now();
+	auto end = std::chrono::steady_clock::now();
 	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 	frameTime = elapsed.count() / 1000.0f;
 	drawTime = elapsed2.count() / 1000.0f;
+
+	if (ENABLE_FRAME_STATISTICS) {
+		auto ms = [](auto duration) { return std::chrono::duration<float, std::milli>(duration).count(); };
+		FrameSample sample{};
+		sample.frameNumber = static_cast<uint64_t>(_frameNumber);
+		sample.acquireWait = ms(acquireEnd - start);
+		sample.record = ms(end2 - start2);
+		sample.submit = ms(submitEnd - end2);
+		sample.present = ms(end - submitEnd);
+		sample.frame = ms(end - start);
+		_frameStatistics.push(sample);
+	}
+
+	//increase the number of frames drawn
+	_frameNumber++;
+}
+
+void MainEngine::set_frame_overlap(uint32_t frameOverlap)
+{
+	_pendingFrameOverlap = std::clamp(frameOverlap, 1u, MAX_FRAME_OVERLAP);
+}
+
+void MainEngine::invalidate_descriptor_caches()
+{
+	// the bindless heap writes through vkGetDescriptorEXT directly and keeps no cache
+	_fullscreenDescriptorBuffer.invalidate_cache();
+}
+
+void MainEngine::apply_frame_overlap()
+{
+	if (_pendingFrameOverlap == 0) { return; }
+	if (_pendingFrameOverlap != _frameOverlap) {
+		// frame slots are remapped, so every submitted frame has to retire first.
+		//  the last submitted frame retiring implies all earlier ones have as well
+		if (_frameNumber > 0) { wait_for_frame_retired(get_frame_timeline_value(_frameNumber - 1)); }
+		invalidate_descriptor_caches();
+		for (int i = 0; i < MAX_FRAME_OVERLAP; i++) {
+			_frames[i]._deletionQueue.flush(_device, _allocator);
+		}
+		fmt::print("Frames in flight changed from {} to {}\n", _frameOverlap, _pendingFrameOverlap);
+		_frameOverlap = _pendingFrameOverlap;
+	}
+	_pendingFrameOverlap = 0;
 }
 
-void MainEngine::draw_fullscreen(VkCommandBuffer cmd, AllocatedImage sourceImage, AllocatedImage targetImage)
+void MainEngine::draw_fullscreen(VkCommandBuffer cmd, ImageHandle sourceImage, ImageHandle targetImage)
 {
 	VkDescriptorImageInfo fullscreenCombined{};
 	fullscreenCombined.sampler = _defaultSamplerNearest;
-	fullscreenCombined.imageView = sourceImage.imageView;
+	fullscreenCombined.imageView = _resources.get_image_view(sourceImage);
 	fullscreenCombined.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 	// needs to match the order of the bindings in the layout
-	std::vector<DescriptorImageData> combined_descriptor = {
+	DescriptorImageData combined_descriptor[] = {
 		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &fullscreenCombined, 1 }
 	};
 
-	_fullscreenDescriptorBuffer.set_data(_device, combined_descriptor, 0);
+	// the previous frames may still be reading their copies. unchanged copies aren't rewritten
+	int setIndex = _fullscreenDescriptorSet.get_index(_frameNumber % _frameOverlap);
+	_fullscreenDescriptorBuffer.set_data(_device, combined_descriptor, setIndex);
 
 	VkRenderingAttachmentInfo colorAttachment;
-	colorAttachment = vkinit::attachment_info(targetImage.imageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	colorAttachment = vkinit::attachment_info(_resources.get_image_view(targetImage), nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 	VkRenderingInfo renderInfo = vkinit::rendering_info(_drawExtent, &colorAttachment, nullptr);
 	vkCmdBeginRendering(cmd, &renderInfo);
 
@@ -204,7 +450,7 @@ void MainEngine::draw_fullscreen(VkCommandBuffer cmd, AllocatedImage sourceImage
 	vkCmdBindDescriptorBuffersEXT(cmd, 1, &descriptor_buffer_binding_info);
 
 	constexpr uint32_t image_buffer_index = 0;
-	VkDeviceSize image_buffer_offset = 0;
+	VkDeviceSize image_buffer_offset = _fullscreenDescriptorBuffer.get_set_offset(setIndex);
 	vkCmdSetDescriptorBufferOffsetsEXT(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _fullscreenPipelineLayout
 		, 0, 1, &image_buffer_index, &image_buffer_offset);
 
@@ -224,6 +470,7 @@ void MainEngine::init_vulkan()
 
 	// make the vulkan instance, with basic debug features
 	auto inst_ret = builder.set_app_name("Will's Vulkan Renderer")
+		.set_headless(_headless)
 		.request_validation_layers(USE_VALIDATION_LAYERS)
 		.use_default_debug_messenger()
 		.require_api_version(1, 3)
@@ -237,7 +484,7 @@ void MainEngine::init_vulkan()
 	_debug_messenger = vkb_inst.debug_messenger;
 
 	// sdl vulkan surface
-	SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
+	if (!_headless) { SDL_Vulkan_CreateSurface(_window, _instance, &_surface); }
 
 
 
@@ -251,9 +498,18 @@ void MainEngine::init_vulkan()
 	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 	features12.bufferDeviceAddress = true;
 	features12.descriptorIndexing = true;
+	features12.timelineSemaphore = true;
+	// bindless heap
+	features12.runtimeDescriptorArray = true;
+	features12.descriptorBindingPartiallyBound = true;
+	features12.descriptorBindingVariableDescriptorCount = true;
+	features12.shaderSampledImageArrayNonUniformIndexing = true;
+	features12.shaderStorageImageArrayNonUniformIndexing = true;
 
 	VkPhysicalDeviceFeatures other_features{};
 	other_features.multiDrawIndirect = true;
+	// bindless storage images are declared without a format
+	other_features.shaderStorageImageWriteWithoutFormat = true;
 	// Descriptor Buffer Extension
 	VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures = {};
 	descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
@@ -263,7 +519,8 @@ void MainEngine::init_vulkan()
 	enabledShaderObjectFeaturesEXT.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
 	enabledShaderObjectFeaturesEXT.shaderObject = VK_TRUE;
 
-	// select gpu
+	// select gpu. a headless instance doesn't require present support, and any device type
+	//  is accepted so software implementations (lavapipe) can be used on machines without a GPU
 	vkb::PhysicalDeviceSelector selector{ vkb_inst };
 	vkb::PhysicalDevice targetDevice = selector
 		.set_minimum_version(1, 3)
@@ -273,8 +530,11 @@ void MainEngine::init_vulkan()
 		.add_required_extension(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)
 		.add_required_extension(VK_EXT_SHADER_OBJECT_EXTENSION_NAME)
 		.set_surface(_surface)
+		.allow_any_gpu_device_type(true)
 		.select()
 		.value();
+	// live per-heap budgets for the memory overlay
+	_memoryBudgetSupported = targetDevice.enable_extension_if_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 
 	vkb::DeviceBuilder deviceBuilder{ targetDevice };
 	deviceBuilder.add_pNext(&descriptorBufferFeatures);
@@ -289,23 +549,38 @@ void MainEngine::init_vulkan()
 	_graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
 	_graphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
+	// Transfer Queue (family without graphics/compute, usually the copy engine)
+	auto transferQueue = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer);
+	if (transferQueue.has_value()) {
+		_transferQueue = transferQueue.value();
+		_transferQueueFamily = vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+	}
+
 	// VMA
 	VmaAllocatorCreateInfo allocatorInfo = {};
 	allocatorInfo.physicalDevice = _physicalDevice;
 	allocatorInfo.device = _device;
 	allocatorInfo.instance = _instance;
 	allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+	if (_memoryBudgetSupported) { allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT; }
+	// core vkGetPhysicalDeviceMemoryProperties2 for the budget query
+	allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_3;
 	VmaVulkanFunctions vulkanFunctions = {};
 	vulkanFunctions.vkGetInstanceProcAddr = vkGetInstanceProcAddr;
 	vulkanFunctions.vkGetDeviceProcAddr = vkGetDeviceProcAddr;
 	allocatorInfo.pVulkanFunctions = &vulkanFunctions;
 	vmaCreateAllocator(&allocatorInfo, &_allocator);
 
+	_memoryPools.init(_device, _allocator);
+	// the pools textures and device local buffers live in, plus the default pools for whatever didn't fit them.
+	//  buffers the host wrote into VRAM are skipped by the defragmenter, the rest of the upload pool can move
+	_defragmenter.init(_device, _allocator, &_resources, { _memoryPools.get_pool(MemoryClass::Textures)
+		, _memoryPools.get_pool(MemoryClass::Buffers), _memoryPools.get_pool(MemoryClass::UploadBuffers), VK_NULL_HANDLE });
 }
 
 void MainEngine::init_swapchain()
 {
-	create_swapchain(_windowExtent.width, _windowExtent.height);
+	if (!_headless) { create_swapchain(_windowExtent.width, _windowExtent.height); }
 	create_draw_images(_windowExtent.width, _windowExtent.height);
 }
 
@@ -314,7 +589,7 @@ void MainEngine::init_commands()
 	VkCommandPoolCreateInfo commandPoolInfo =
 		vkinit::command_pool_create_info(_graphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-	for (int i = 0; i < FRAME_OVERLAP; i++) {
+	for (int i = 0; i < MAX_FRAME_OVERLAP; i++) {
 		VK_CHECK(vkCreateCommandPool(_device, &commandPoolInfo, nullptr, &_frames[i]._commandPool));
 
 		VkCommandBufferAllocateInfo cmdAllocInfo =
@@ -323,31 +598,51 @@ void MainEngine::init_commands()
 		VK_CHECK(vkAllocateCommandBuffers(_device, &cmdAllocInfo, &_frames[i]._mainCommandBuffer));
 	}
 
-	// Immediate Rendering
-	VK_CHECK(vkCreateCommandPool(_device, &commandPoolInfo, nullptr, &_immCommandPool));
-	VkCommandBufferAllocateInfo immCmdAllocInfo =
-		vkinit::command_buffer_allocate_info(_immCommandPool);
-	VK_CHECK(vkAllocateCommandBuffers(_device, &immCmdAllocInfo, &_immCommandBuffer));
+	_gpuProfiler.init(_device, _physicalDevice, _graphicsQueueFamily, MAX_FRAME_OVERLAP);
+	_uploadManager.init(_device, _allocator, _memoryPools, _transferQueue, _transferQueueFamily, _graphicsQueue, _graphicsQueueFamily);
 }
 
 void MainEngine::init_sync_structures()
 {
 	//create syncronization structures
-	//one fence to control when the gpu has finished rendering the frame,
-	//and 2 semaphores to syncronize rendering with swapchain
-	//we want the fence to start signalled so we can wait on it on the first frame
-	VkFenceCreateInfo fenceCreateInfo = vkinit::fence_create_info(VK_FENCE_CREATE_SIGNALED_BIT);
+	//one timeline semaphore to track which frames the gpu has finished,
+	//and 2 semaphores per frame to syncronize rendering with swapchain
+	//the timeline starts at 0, so waiting on a frame that was never submitted returns immediately
 	VkSemaphoreCreateInfo semaphoreCreateInfo = vkinit::semaphore_create_info();
 
-	for (int i = 0; i < FRAME_OVERLAP; i++) {
-		VK_CHECK(vkCreateFence(_device, &fenceCreateInfo, nullptr, &_frames[i]._renderFence));
+	VkSemaphoreTypeCreateInfo timelineTypeInfo = vkinit::semaphore_type_create_info(VK_SEMAPHORE_TYPE_TIMELINE, 0);
+	VkSemaphoreCreateInfo timelineCreateInfo = vkinit::semaphore_create_info();
+	timelineCreateInfo.pNext = &timelineTypeInfo;
+	VK_CHECK(vkCreateSemaphore(_device, &timelineCreateInfo, nullptr, &_frameTimeline));
 
+	for (int i = 0; i < MAX_FRAME_OVERLAP; i++) {
 		VK_CHECK(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &_frames[i]._swapchainSemaphore));
 		VK_CHECK(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &_frames[i]._renderSemaphore));
 	}
+}
 
-	// Immediate Rendeirng
-	VK_CHECK(vkCreateFence(_device, &fenceCreateInfo, nullptr, &_immFence));
+void MainEngine::init_frame_allocators()
+{
+	for (int i = 0; i < MAX_FRAME_OVERLAP; i++) {
+		_frames[i]._frameAllocator.init(_device, _physicalDevice, _allocator, _memoryPools, FRAME_ALLOCATOR_SIZE);
+	}
+}
+
+uint64_t MainEngine::get_retired_frame_value()
+{
+	uint64_t value;
+	VK_CHECK(vkGetSemaphoreCounterValue(_device, _frameTimeline, &value));
+	return value;
+}
+
+void MainEngine::wait_for_frame_retired(uint64_t frameValue, uint64_t timeout)
+{
+	VkSemaphoreWaitInfo waitInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.pNext = nullptr;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &_frameTimeline;
+	waitInfo.pValues = &frameValue;
+	VK_CHECK(vkWaitSemaphores(_device, &waitInfo, timeout));
 }
 
 #pragma region DearImGui
@@ -413,12 +708,172 @@ void MainEngine::layout_imgui()
 	if (ImGui::Begin("Main")) {
 		ImGui::Text("Frame Time: %.2f ms", frameTime);
 		ImGui::Text("Draw Time: %.2f ms", drawTime);
+		ImGui::Text("Input Latency: %.2f ms (avg %.2f ms)", inputLatency, averageInputLatency);
+
+		if (ENABLE_FRAME_STATISTICS && ImGui::CollapsingHeader("Frame Statistics")) {
+			layout_frame_statistics();
+		}
+		ImGui::Text("Render Graph: %u passes culled", _renderGraph.get_culled_pass_count());
+		if (_gpuProfiler.is_supported() && ImGui::CollapsingHeader("GPU Timings")) {
+			layout_gpu_timings();
+		}
+		if (ImGui::CollapsingHeader("Memory")) {
+			layout_memory_budget();
+		}
+
+		int frameOverlap = static_cast<int>(_frameOverlap);
+		if (ImGui::SliderInt("Frames In Flight", &frameOverlap, 1, MAX_FRAME_OVERLAP)) {
+			set_frame_overlap(static_cast<uint32_t>(frameOverlap));
+		}
+
+		if (ImGui::BeginCombo("Present Mode", string_VkPresentModeKHR(_presentMode))) {
+			for (VkPresentModeKHR mode : _supportedPresentModes) {
+				if (ImGui::Selectable(string_VkPresentModeKHR(mode), mode == _presentMode)) {
+					set_present_mode(mode);
+				}
+			}
+			ImGui::EndCombo();
+		}
+		ImGui::SliderFloat("Frame Rate Cap (0 = off)", &_targetFrameRate, 0.0f, 500.0f, "%.0f");
+		ImGui::Checkbox("Low Latency Mode", &_lowLatencyMode);
 	}
 	ImGui::End();
 	ImGui::Render();
 
 }
 
+void MainEngine::layout_frame_statistics()
+{
+	_frameStatistics.snapshot(_frameSampleScratch);
+	if (_frameSampleScratch.empty()) { return; }
+
+	std::vector<float>& values = _frameStatisticsScratch;
+	values.resize(_frameSampleScratch.size());
+
+	for (size_t i = 0; i < _frameSampleScratch.size(); i++) { values[i] = _frameSampleScratch[i].frame; }
+	ImGui::PlotLines("##FrameTimes", values.data(), static_cast<int>(values.size()), 0
+		, "Frame Time (ms)", 0.0f, FLT_MAX, ImVec2(0, 80));
+
+	if (ImGui::BeginTable("FramePercentiles", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+		ImGui::TableSetupColumn("(ms)");
+		ImGui::TableSetupColumn("p50");
+		ImGui::TableSetupColumn("p95");
+		ImGui::TableSetupColumn("p99");
+		ImGui::TableHeadersRow();
+
+		auto row = [&](const char* name, float FrameSample::* field) {
+			for (size_t i = 0; i < _frameSampleScratch.size(); i++) { values[i] = _frameSampleScratch[i].*field; }
+			FramePercentiles p = FrameStatistics::percentiles(values);
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::TextUnformatted(name);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", p.p50);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", p.p95);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", p.p99);
+			};
+		row("Frame", &FrameSample::frame);
+		row("Acquire Wait", &FrameSample::acquireWait);
+		row("Record", &FrameSample::record);
+		row("Submit", &FrameSample::submit);
+		row("Present", &FrameSample::present);
+		ImGui::EndTable();
+	}
+	ImGui::Text("%zu samples", _frameSampleScratch.size());
+
+	if (ImGui::Button("Export CSV")) {
+		_frameStatistics.write_csv(_frameStatisticsPath);
+	}
+}
+
+void MainEngine::layout_gpu_timings()
+{
+	if (ImGui::BeginTable("GpuTimings", 2, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+		ImGui::TableSetupColumn("Scope");
+		ImGui::TableSetupColumn("GPU (ms)");
+		ImGui::TableHeadersRow();
+		for (const GpuProfiler::ScopeResult& result : _gpuProfiler.get_results()) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			// indent children under their parent scope
+			ImGui::Text("%*s%s", static_cast<int>(result.depth * 2), "", result.name);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", result.milliseconds);
+		}
+		ImGui::EndTable();
+	}
+}
+
+void MainEngine::layout_memory_budget()
+{
+	const VkPhysicalDeviceMemoryProperties* memoryProperties;
+	vmaGetMemoryProperties(_allocator, &memoryProperties);
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(_allocator, budgets);
+
+	if (!_memoryBudgetSupported) { ImGui::TextUnformatted("VK_EXT_memory_budget unavailable, budgets are estimates"); }
+
+	constexpr float MB = 1024.0f * 1024.0f;
+	if (ImGui::BeginTable("MemoryHeaps", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+		ImGui::TableSetupColumn("Heap");
+		ImGui::TableSetupColumn("Usage / Budget (MB)");
+		ImGui::TableSetupColumn("Blocks");
+		ImGui::TableSetupColumn("Allocations");
+		ImGui::TableHeadersRow();
+		for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++) {
+			const VmaBudget& budget = budgets[i];
+			bool deviceLocal = memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::Text("%u%s", i, deviceLocal ? " (device)" : "");
+			ImGui::TableNextColumn();
+			float fraction = budget.budget > 0 ? static_cast<float>(budget.usage) / budget.budget : 0.0f;
+			std::string overlay = fmt::format("{:.1f} / {:.1f}", budget.usage / MB, budget.budget / MB);
+			ImGui::ProgressBar(fraction, ImVec2(-FLT_MIN, 0), overlay.c_str());
+			ImGui::TableNextColumn(); ImGui::Text("%u", budget.statistics.blockCount);
+			ImGui::TableNextColumn(); ImGui::Text("%u (%.1f MB)", budget.statistics.allocationCount, budget.statistics.allocationBytes / MB);
+		}
+		ImGui::EndTable();
+	}
+
+	if (ImGui::BeginTable("MemoryPools", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+		ImGui::TableSetupColumn("Pool");
+		ImGui::TableSetupColumn("Used / Blocks (MB)");
+		ImGui::TableSetupColumn("Allocations");
+		ImGui::TableSetupColumn("Fallbacks");
+		ImGui::TableHeadersRow();
+		for (uint32_t i = 0; i < MemoryPools::CLASS_COUNT; i++) {
+			MemoryClass memoryClass = static_cast<MemoryClass>(i);
+			VmaDetailedStatistics stats = _memoryPools.get_statistics(memoryClass);
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::Text("%s%s", _memoryPools.get_name(memoryClass), _memoryPools.is_linear(memoryClass) ? " (linear)" : "");
+			ImGui::TableNextColumn();
+			float fraction = stats.statistics.blockBytes > 0 ? static_cast<float>(stats.statistics.allocationBytes) / stats.statistics.blockBytes : 0.0f;
+			std::string overlay = fmt::format("{:.1f} / {:.1f}", stats.statistics.allocationBytes / MB, stats.statistics.blockBytes / MB);
+			ImGui::ProgressBar(fraction, ImVec2(-FLT_MIN, 0), overlay.c_str());
+			ImGui::TableNextColumn(); ImGui::Text("%u", stats.statistics.allocationCount);
+			ImGui::TableNextColumn(); ImGui::Text("%u", _memoryPools.get_fallback_count(memoryClass));
+		}
+		ImGui::EndTable();
+	}
+	ImGui::Text("Draw Images: %.1f MB (%.1f MB before aliasing)"
+		, _transientImages.get_allocated_size() / MB, _transientImages.get_requested_size() / MB);
+
+	VkDeviceSize reclaimableBytes;
+	float fragmentation = _defragmenter.get_fragmentation(&reclaimableBytes);
+	ImGui::Text("Fragmentation: %.1f%% (%.1f MB unused in blocks)", fragmentation * 100.0f, reclaimableBytes / MB);
+	ImGui::Checkbox("Auto Defragment", &_autoDefragment);
+	ImGui::SameLine();
+	if (_defragmenter.is_running()) { ImGui::TextUnformatted("Defragmenting..."); }
+	else if (ImGui::Button("Defragment")) { _defragmenter.begin(); }
+	if (_defragmenter.get_completed_count() > 0) {
+		const VmaDefragmentationStats& stats = _defragmenter.get_last_stats();
+		ImGui::Text("Last: moved %u allocations (%.1f MB), freed %.1f MB in %u blocks"
+			, stats.allocationsMoved, stats.bytesMoved / MB, stats.bytesFreed / MB, stats.deviceMemoryBlocksFreed);
+	}
+
+	if (ImGui::Button("Dump Allocator Stats")) {
+		write_memory_stats(_memoryStatsPath);
+	}
+}
+
 void MainEngine::draw_imgui(VkCommandBuffer cmd, VkImageView targetImageView)
 {
 	VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(targetImageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
@@ -432,18 +887,21 @@ void MainEngine::draw_imgui(VkCommandBuffer cmd, VkImageView targetImageView)
 void MainEngine::init_default_data()
 {
 #pragma region Basic Textures
+	// every default texture goes up in one submission
+	UploadBatch batch(_uploadManager);
+
 	//3 default textures, white, grey, black. 1 pixel each
 	uint32_t white = glm::packUnorm4x8(glm::vec4(1, 1, 1, 1));
-	_whiteImage = create_image((void*)&white, 4, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_USAGE_SAMPLED_BIT);
+	_whiteImage = _resources.add_image(create_image(batch, (void*)&white, 4, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT));
 
 	uint32_t grey = glm::packUnorm4x8(glm::vec4(0.66f, 0.66f, 0.66f, 1));
-	_greyImage = create_image((void*)&grey, 4, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_USAGE_SAMPLED_BIT);
+	_greyImage = _resources.add_image(create_image(batch, (void*)&grey, 4, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT));
 
 	uint32_t black = glm::packUnorm4x8(glm::vec4(0, 0, 0, 0));
-	_blackImage = create_image((void*)&black, 4, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_USAGE_SAMPLED_BIT);
+	_blackImage = _resources.add_image(create_image(batch, (void*)&black, 4, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT));
 
 	//checkerboard image
 	uint32_t magenta = glm::packUnorm4x8(glm::vec4(1, 0, 1, 1));
@@ -453,8 +911,11 @@ void MainEngine::init_default_data()
 			pixels[y * 16 + x] = ((x % 2) ^ (y % 2)) ? magenta : black;
 		}
 	}
-	_errorCheckerboardImage = create_image(pixels.data(), 16 * 16 * 4, VkExtent3D{ 16, 16, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_USAGE_SAMPLED_BIT);
+	_errorCheckerboardImage = _resources.add_image(create_image(batch, pixels.data(), 16 * 16 * 4, VkExtent3D{ 16, 16, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT));
+
+	// the first frame samples these, so they have to be complete before it's recorded
+	_uploadManager.wait(batch.submit());
 #pragma endregion
 
 #pragma region Default Samplers
@@ -470,16 +931,73 @@ void MainEngine::init_default_data()
 	vkCreateSampler(_device, &sampl, nullptr, &_defaultSamplerLinear);
 
 	_mainDeletionQueue.push_function([&]() {
-		destroy_image(_whiteImage);
-		destroy_image(_greyImage);
-		destroy_image(_blackImage);
-		destroy_image(_errorCheckerboardImage);
+		destroy_image(_resources.remove_image(_whiteImage));
+		destroy_image(_resources.remove_image(_greyImage));
+		destroy_image(_resources.remove_image(_blackImage));
+		destroy_image(_resources.remove_image(_errorCheckerboardImage));
 		vkDestroySampler(_device, _defaultSamplerNearest, nullptr);
 		vkDestroySampler(_device, _defaultSamplerLinear, nullptr);
+		invalidate_descriptor_caches();
 		});
 #pragma endregion
 }
 
+#pragma region Bindless
+void MainEngine::init_bindless()
+{
+	uint32_t maxSampledImages = BINDLESS_MAX_SAMPLED_IMAGES;
+	uint32_t maxSamplers = BINDLESS_MAX_SAMPLERS;
+	uint32_t maxStorageImages = BINDLESS_MAX_STORAGE_IMAGES;
+	_bindlessDescriptorSetLayout = DescriptorBufferBindless::create_layout(_device, _physicalDevice
+		, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT
+		, maxSampledImages, maxSamplers, maxStorageImages);
+	_bindlessHeap = DescriptorBufferBindless(_instance, _device, _physicalDevice, _allocator, _memoryPools
+		, _bindlessDescriptorSetLayout, maxSampledImages, maxSamplers, maxStorageImages);
+
+	_bindlessSamplerNearest = _bindlessHeap.register_sampler(_device, _defaultSamplerNearest);
+	_bindlessSamplerLinear = _bindlessHeap.register_sampler(_device, _defaultSamplerLinear);
+	register_bindless_image(_whiteImage);
+	register_bindless_image(_greyImage);
+	register_bindless_image(_blackImage);
+	register_bindless_image(_errorCheckerboardImage);
+
+	_mainDeletionQueue.push_function([&]() {
+		_bindlessImages.clear();
+		_bindlessHeap.destroy(_device, _allocator);
+		vkDestroyDescriptorSetLayout(_device, _bindlessDescriptorSetLayout, nullptr);
+		});
+}
+
+uint32_t MainEngine::register_bindless_image(ImageHandle image)
+{
+	uint32_t index = image.index();
+	if (index < _bindlessImages.size() && _bindlessImages[index] == image) { return index; }
+	if (index >= _bindlessHeap.get_sampled_image_capacity()) {
+		fmt::print("Image handle index {} is outside the bindless heap (capacity {})\n", index, _bindlessHeap.get_sampled_image_capacity());
+		abort();
+	}
+	if (index >= _bindlessImages.size()) { _bindlessImages.resize(index + 1); }
+	// a previous image in the slot that was destroyed without unregistering makes the claim abort
+	_bindlessHeap.claim_sampled_image(_device, index, _resources.get_image_view(image));
+	_bindlessImages[index] = image;
+	return index;
+}
+
+void MainEngine::unregister_bindless_image(ImageHandle image)
+{
+	if (get_bindless_index(image) == DescriptorBufferBindless::INVALID_INDEX) { return; }
+	_bindlessHeap.unregister_sampled_image(image.index());
+	_bindlessImages[image.index()] = {};
+}
+
+uint32_t MainEngine::get_bindless_index(ImageHandle image) const
+{
+	uint32_t index = image.index();
+	bool registered = !image.is_null() && index < _bindlessImages.size() && _bindlessImages[index] == image;
+	return registered ? index : DescriptorBufferBindless::INVALID_INDEX;
+}
+#pragma endregion
+
 void MainEngine::init_pipeline()
 {
 	{
@@ -491,17 +1009,9 @@ void MainEngine::init_pipeline()
 
 	}
 	_fullscreenDescriptorBuffer = DescriptorBufferSampler(_instance, _device
-		, _physicalDevice, _allocator, _fullscreenDescriptorSetLayout, 1);
-
-	VkDescriptorImageInfo fullscreenCombined{};
-	fullscreenCombined.sampler = _defaultSamplerNearest;
-	fullscreenCombined.imageView = _errorCheckerboardImage.imageView;
-	fullscreenCombined.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	// needs to match the order of the bindings in the layout
-	std::vector<DescriptorImageData> combined_descriptor = {
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &fullscreenCombined, 1 }
-	};
-	_fullscreenDescriptorBuffer.setup_data(_device, combined_descriptor);
+		, _physicalDevice, _allocator, _memoryPools, _fullscreenDescriptorSetLayout, VersionedDescriptorSet::MAX_VERSIONS);
+	// written by draw_fullscreen()
+	_fullscreenDescriptorSet = _fullscreenDescriptorBuffer.allocate_versioned_set(_device);
 
 	VkPipelineLayoutCreateInfo layout_info = vkinit::pipeline_layout_create_info();
 	layout_info.setLayoutCount = 1;
@@ -547,90 +1057,145 @@ void MainEngine::init_pipeline()
 
 
 void MainEngine::create_draw_images(uint32_t width, uint32_t height) {
-	// Draw Image
+	// draw images are only ever grown, a smaller swapchain renders into a sub-region (see _drawExtent)
+	if (!_drawImage.is_null()) {
+		VkExtent3D drawImageExtent = _resources.get_image_extent(_drawImage);
+		if (width <= drawImageExtent.width && height <= drawImageExtent.height) { return; }
+		width = std::max(width, drawImageExtent.width);
+		height = std::max(height, drawImageExtent.height);
+
+		// frames still in flight may be reading the old images
+		unregister_draw_images();
+		_transientImages.retire(get_current_frame()._deletionQueue);
+	}
+
+	_transientImages = {};
+	_transientImages.init(_device, _physicalDevice, _allocator, _memoryPools);
+	// MSAA color and depth are never read after the frame, tile based GPUs can keep them in tile memory
+	VkImageUsageFlags lazyUsage = _transientImages.supports_lazy_memory() ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0;
+
+	// Draw Image - the resolve target when using MSAA
+	TransientImage drawImage;
 	{
-		_drawImage.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-		VkExtent3D drawImageExtent = { width, height, 1 };
-		_drawImage.imageExtent = drawImageExtent;
 		VkImageUsageFlags drawImageUsages{};
 		drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 		drawImageUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
 		drawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 		drawImageUsages |= VK_IMAGE_USAGE_SAMPLED_BIT;
-		VkImageCreateInfo rimg_info = vkinit::image_create_info(_drawImage.imageFormat, drawImageUsages, drawImageExtent);
-		VmaAllocationCreateInfo rimg_allocinfo = {};
-		rimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-		rimg_allocinfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);// only found on GPU
-		vmaCreateImage(_allocator, &rimg_info, &rimg_allocinfo, &_drawImage.image, &_drawImage.allocation, nullptr);
-
-		VkImageViewCreateInfo rview_info = vkinit::imageview_create_info(_drawImage.imageFormat, _drawImage.image
-			, VK_IMAGE_ASPECT_COLOR_BIT);
-		VK_CHECK(vkCreateImageView(_device, &rview_info, nullptr, &_drawImage.imageView));
+		VkImageCreateInfo rimg_info = vkinit::image_create_info(VK_FORMAT_R16G16B16A16_SFLOAT, drawImageUsages, { width, height, 1 });
+		drawImage = _transientImages.add_image(rimg_info, VK_IMAGE_ASPECT_COLOR_BIT, USE_MSAA ? DRAW_PHASE_RESOLVE : DRAW_PHASE_GEOMETRY, DRAW_PHASE_OUTPUT);
 	}
 
 	// MSAA pre-resolve image
-
+	TransientImage drawImageBeforeMSAA{ 0 };
 	if (USE_MSAA) {
-		_drawImageBeforeMSAA.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-		VkExtent3D msaaImageExtent = { width, height, 1 };
 		VkImageUsageFlags msaaImageUsages{};
 		msaaImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 		msaaImageUsages |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
-		VkImageCreateInfo msaaimg_info = vkinit::image_create_info(_drawImageBeforeMSAA.imageFormat, msaaImageUsages, msaaImageExtent);
-		//msaaimg_info = vkinit::image_create_info(_drawImageBeforeMSAA.imageFormat, msaaImageUsages, msaaImageExtent);
+		VkImageCreateInfo msaaimg_info = vkinit::image_create_info(VK_FORMAT_R16G16B16A16_SFLOAT, msaaImageUsages, { width, height, 1 });
 		msaaimg_info.samples = MSAA_SAMPLES;
-		VmaAllocationCreateInfo msaaimg_allocinfo = {};
-		msaaimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-		msaaimg_allocinfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);// only found on GPU
-		vmaCreateImage(_allocator, &msaaimg_info, &msaaimg_allocinfo, &_drawImageBeforeMSAA.image, &_drawImageBeforeMSAA.allocation, nullptr);
-
-		VkImageViewCreateInfo rview_info_before_msaa = vkinit::imageview_create_info(
-			_drawImageBeforeMSAA.imageFormat, _drawImageBeforeMSAA.image, VK_IMAGE_ASPECT_COLOR_BIT);
-		VK_CHECK(vkCreateImageView(_device, &rview_info_before_msaa, nullptr, &_drawImageBeforeMSAA.imageView));
+		drawImageBeforeMSAA = _transientImages.add_image(msaaimg_info, VK_IMAGE_ASPECT_COLOR_BIT, DRAW_PHASE_GEOMETRY, DRAW_PHASE_RESOLVE);
 	}
 
-
 	// Depth Image
+	TransientImage depthImage;
 	{
-
-		_depthImage.imageFormat = VK_FORMAT_D32_SFLOAT;
-		VkExtent3D depthImageExtent = { width, height, 1 };
-		_depthImage.imageExtent = depthImageExtent;
 		VkImageUsageFlags depthImageUsages{};
 		depthImageUsages |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-		VkImageCreateInfo dimg_info = vkinit::image_create_info(_depthImage.imageFormat, depthImageUsages, depthImageExtent);
-
+		depthImageUsages |= lazyUsage;
+		VkImageCreateInfo dimg_info = vkinit::image_create_info(VK_FORMAT_D32_SFLOAT, depthImageUsages, { width, height, 1 });
 		if (USE_MSAA) { dimg_info.samples = MSAA_SAMPLES; }
+		// the MSAA resolve happens at vkCmdEndRendering of the pass depth is bound to, so depth lives through it
+		depthImage = _transientImages.add_image(dimg_info, VK_IMAGE_ASPECT_DEPTH_BIT, DRAW_PHASE_GEOMETRY, DRAW_PHASE_RESOLVE);
+	}
 
-		VmaAllocationCreateInfo dimg_allocinfo = {};
-		dimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-		dimg_allocinfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);// only found on GPU
-		vmaCreateImage(_allocator, &dimg_info, &dimg_allocinfo, &_depthImage.image, &_depthImage.allocation, nullptr);
+	_transientImages.build();
+	// the pool owns these, the registry only hands out handles to them
+	_drawImage = _resources.add_image(_transientImages.get_image(drawImage));
+	_depthImage = _resources.add_image(_transientImages.get_image(depthImage));
+	if (USE_MSAA) { _drawImageBeforeMSAA = _resources.add_image(_transientImages.get_image(drawImageBeforeMSAA)); }
 
-		VkImageViewCreateInfo dview_info = vkinit::imageview_create_info(_depthImage.imageFormat, _depthImage.image
-			, VK_IMAGE_ASPECT_DEPTH_BIT);
-		VK_CHECK(vkCreateImageView(_device, &dview_info, nullptr, &_depthImage.imageView));
+	fmt::print("Draw images: {:.1f} MB allocated for {:.1f} MB of render targets, {} lazily allocated\n"
+		, _transientImages.get_allocated_size() / (1024.0 * 1024.0), _transientImages.get_requested_size() / (1024.0 * 1024.0)
+		, _transientImages.get_lazy_count());
+}
+
+void MainEngine::set_present_mode(VkPresentModeKHR presentMode)
+{
+	_requestedPresentMode = presentMode;
+	if (_swapchain != VK_NULL_HANDLE && choose_present_mode(presentMode) != _presentMode) {
+		resize_requested = true;
 	}
+}
 
+VkPresentModeKHR MainEngine::choose_present_mode(VkPresentModeKHR requested)
+{
+	auto supported = [&](VkPresentModeKHR mode) {
+		return std::find(_supportedPresentModes.begin(), _supportedPresentModes.end(), mode) != _supportedPresentModes.end();
+		};
+
+	// fall back towards the closest behaviour: uncapped modes to each other, everything else to vsync
+	std::vector<VkPresentModeKHR> candidates{ requested };
+	if (requested == VK_PRESENT_MODE_IMMEDIATE_KHR) { candidates.push_back(VK_PRESENT_MODE_MAILBOX_KHR); }
+	if (requested == VK_PRESENT_MODE_FIFO_RELAXED_KHR) { candidates.push_back(VK_PRESENT_MODE_FIFO_KHR); }
 
+	for (VkPresentModeKHR mode : candidates) {
+		if (supported(mode)) { return mode; }
+	}
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void MainEngine::resize_swapchain()
+{
+	int width, height;
+	SDL_Vulkan_GetDrawableSize(_window, &width, &height);
+	// minimized, keep the request pending until the window has an area again
+	if (width == 0 || height == 0) { return; }
+
+	_windowExtent.width = static_cast<uint32_t>(width);
+	_windowExtent.height = static_cast<uint32_t>(height);
+
+	create_swapchain(_windowExtent.width, _windowExtent.height);
+	create_draw_images(_windowExtent.width, _windowExtent.height);
+
+	resize_requested = false;
 }
 
 void MainEngine::create_swapchain(uint32_t width, uint32_t height) {
 	vkb::SwapchainBuilder swapchainBuilder{ _physicalDevice,_device,_surface };
+	// VK_NULL_HANDLE on first creation
+	VkSwapchainKHR oldSwapchain = _swapchain;
+
+	uint32_t presentModeCount;
+	VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(_physicalDevice, _surface, &presentModeCount, nullptr));
+	_supportedPresentModes.resize(presentModeCount);
+	VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(_physicalDevice, _surface, &presentModeCount, _supportedPresentModes.data()));
+
+	_presentMode = choose_present_mode(_requestedPresentMode);
+	if (_presentMode != _requestedPresentMode) {
+		fmt::print("Present mode {} not supported, using {}\n", string_VkPresentModeKHR(_requestedPresentMode), string_VkPresentModeKHR(_presentMode));
+	}
 
 	_swapchainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
 
 	vkb::Swapchain vkbSwapchain = swapchainBuilder
 		//.use_default_format_selection()
 		.set_desired_format(VkSurfaceFormatKHR{ .format = _swapchainImageFormat, .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR })
-		//use vsync present mode
-		.set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+		.set_desired_present_mode(_presentMode)
 		.set_desired_extent(width, height)
 		.add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		.set_old_swapchain(oldSwapchain)
 		.build()
 		.value();
 
+	if (oldSwapchain != VK_NULL_HANDLE) {
+		// previous frames may still present from the old swapchain, retire it with the current frame
+		std::vector<VkImageView> oldImageViews = std::move(_swapchainImageViews);
+		for (VkImageView imageView : oldImageViews) { get_current_frame()._deletionQueue.push(imageView); }
+		get_current_frame()._deletionQueue.push(oldSwapchain);
+	}
+
 	_swapchainExtent = vkbSwapchain.extent;
 
 	// Swapchain and SwapchainImages
@@ -640,22 +1205,25 @@ void MainEngine::create_swapchain(uint32_t width, uint32_t height) {
 
 }
 
-void MainEngine::destroy_swapchain() {
-	vkDestroySwapchainKHR(_device, _swapchain, nullptr);
-	for (int i = 0; i < _swapchainImageViews.size(); i++) {
-		vkDestroyImageView(_device, _swapchainImageViews[i], nullptr);
+void MainEngine::destroy_swapchain(VkSwapchainKHR swapchain, const std::vector<VkImageView>& imageViews) {
+	vkDestroySwapchainKHR(_device, swapchain, nullptr);
+	for (int i = 0; i < imageViews.size(); i++) {
+		vkDestroyImageView(_device, imageViews[i], nullptr);
 	}
 }
 
+void MainEngine::unregister_draw_images() {
+	_resources.remove_image(_drawImage);
+	_resources.remove_image(_depthImage);
+	if (USE_MSAA) { _resources.remove_image(_drawImageBeforeMSAA); }
+	_drawImage = {};
+	_depthImage = {};
+	_drawImageBeforeMSAA = {};
+}
+
 void MainEngine::destroy_draw_iamges() {
-	vkDestroyImageView(_device, _drawImage.imageView, nullptr);
-	vmaDestroyImage(_allocator, _drawImage.image, _drawImage.allocation);
-	vkDestroyImageView(_device, _depthImage.imageView, nullptr);
-	vmaDestroyImage(_allocator, _depthImage.image, _depthImage.allocation);
-	if (USE_MSAA) {
-		vkDestroyImageView(_device, _drawImageBeforeMSAA.imageView, nullptr);
-		vmaDestroyImage(_allocator, _drawImageBeforeMSAA.image, _drawImageBeforeMSAA.allocation);
-	}
+	unregister_draw_images();
+	_transientImages.destroy();
 }
 
 void MainEngine::cleanup() {
@@ -663,9 +1231,12 @@ void MainEngine::cleanup() {
 	fmt::print("Cleaning up\n");
 	auto start = std::chrono::system_clock::now();
 
-	SDL_SetRelativeMouseMode(SDL_FALSE);
+	if (!_headless) { SDL_SetRelativeMouseMode(SDL_FALSE); }
 
 	vkDeviceWaitIdle(_device);
+
+	if (ENABLE_FRAME_STATISTICS) { _frameStatistics.write_csv(_frameStatisticsPath); }
+	if (_dumpMemoryStatsOnExit) { write_memory_stats(_memoryStatsPath); }
 	//loadedMultiDrawScenes.clear();
 
 	//vkDestroyDescriptorSetLayout(_device, bufferAddressesDescriptorSetLayout, nullptr);
@@ -674,36 +1245,45 @@ void MainEngine::cleanup() {
 	//vkDestroyDescriptorSetLayout(_device, computeCullingDescriptorSetLayout, nullptr);
 
 
+	// returns the last pass's moves to VMA before any resource it moved is destroyed
+	_defragmenter.destroy(get_current_frame()._deletionQueue);
 	_mainDeletionQueue.flush();
 
-	ImGui_ImplVulkan_Shutdown();
-	vkDestroyDescriptorPool(_device, imguiPool, nullptr);
+	if (!_headless) {
+		ImGui_ImplVulkan_Shutdown();
+		vkDestroyDescriptorPool(_device, imguiPool, nullptr);
+	}
 
 
-	for (int i = 0; i < FRAME_OVERLAP; i++) {
+	for (int i = 0; i < MAX_FRAME_OVERLAP; i++) {
+		// resources retired by frames that never got reused (e.g. old swapchains)
+		_frames[i]._deletionQueue.flush(_device, _allocator);
+		_frames[i]._frameAllocator.destroy();
 		vkDestroyCommandPool(_device, _frames[i]._commandPool, nullptr);
 
 		//destroy sync objects
-		vkDestroyFence(_device, _frames[i]._renderFence, nullptr);
 		vkDestroySemaphore(_device, _frames[i]._renderSemaphore, nullptr);
 		vkDestroySemaphore(_device, _frames[i]._swapchainSemaphore, nullptr);
 	}
 
-	vkDestroyCommandPool(_device, _immCommandPool, nullptr);
-	vkDestroyFence(_device, _immFence, nullptr);
+	vkDestroySemaphore(_device, _frameTimeline, nullptr);
+	_gpuProfiler.destroy(_device);
+	_uploadManager.destroy();
 
 	destroy_draw_iamges();
-	destroy_swapchain();
+	if (!_headless) { destroy_swapchain(_swapchain, _swapchainImageViews); }
+	_resources.destroy();
 
+	_memoryPools.destroy();
 	vmaDestroyAllocator(_allocator);
 
-	vkDestroySurfaceKHR(_instance, _surface, nullptr);
+	if (!_headless) { vkDestroySurfaceKHR(_instance, _surface, nullptr); }
 	vkDestroyDevice(_device, nullptr);
 
 	vkb::destroy_debug_utils_messenger(_instance, _debug_messenger);
 	vkDestroyInstance(_instance, nullptr);
 
-	SDL_DestroyWindow(_window);
+	if (!_headless) { SDL_DestroyWindow(_window); }
 	auto end = std::chrono::system_clock::now();
 	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 	fmt::print("Cleanup done in {} seconds\n", elapsed.count() / 1000000.0f);
@@ -711,27 +1291,25 @@ void MainEngine::cleanup() {
 }
 
 
-void MainEngine::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function)
+bool MainEngine::write_memory_stats(const std::string& path)
 {
-	VK_CHECK(vkResetFences(_device, 1, &_immFence));
-	VK_CHECK(vkResetCommandBuffer(_immCommandBuffer, 0));
-
-	VkCommandBuffer cmd = _immCommandBuffer;
-	VkCommandBufferBeginInfo cmdBeginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-	VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
-	function(cmd);
-	VK_CHECK(vkEndCommandBuffer(cmd));
-
-	VkCommandBufferSubmitInfo cmdSubmitInfo = vkinit::command_buffer_submit_info(cmd);
-	VkSubmitInfo2 submitInfo = vkinit::submit_info(&cmdSubmitInfo, nullptr, nullptr);
-
-	VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submitInfo, _immFence));
+	char* statsString;
+	vmaBuildStatsString(_allocator, &statsString, VK_TRUE);
+
+	std::ofstream file(path);
+	bool opened = file.is_open();
+	if (opened) {
+		file << statsString;
+		fmt::print("Wrote allocator statistics to {}\n", path);
+	}
+	else {
+		fmt::print("Failed to open {} for writing allocator statistics\n", path);
+	}
 
-	VK_CHECK(vkWaitForFences(_device, 1, &_immFence, true, 1000000000));
+	vmaFreeStatsString(_allocator, statsString);
+	return opened;
 }
 
-
-
 #pragma region TEXTURES
 AllocatedImage MainEngine::create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped)
 {
@@ -743,6 +1321,8 @@ AllocatedImage MainEngine::create_image(VkExtent3D size, VkFormat format, VkImag
 	if (mipmapped) {
 		img_info.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(size.width, size.height)))) + 1;
 	}
+	newImage.mipLevels = img_info.mipLevels;
+	newImage.imageUsage = usage;
 
 	// always allocate images on dedicated GPU memory
 	VmaAllocationCreateInfo allocinfo = {};
@@ -750,7 +1330,7 @@ AllocatedImage MainEngine::create_image(VkExtent3D size, VkFormat format, VkImag
 	allocinfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
 	// allocate and create the image
-	VK_CHECK(vmaCreateImage(_allocator, &img_info, &allocinfo, &newImage.image, &newImage.allocation, nullptr));
+	VK_CHECK(_memoryPools.create_image(MemoryClass::Textures, img_info, allocinfo, &newImage.image, &newImage.allocation));
 
 	// if the format is a depth format, we will need to have it use the correct
 	// aspect flag
@@ -768,46 +1348,21 @@ AllocatedImage MainEngine::create_image(VkExtent3D size, VkFormat format, VkImag
 	return newImage;
 }
 
-AllocatedImage MainEngine::create_image(void* data, size_t dataSize, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped)
+AllocatedImage MainEngine::create_image(void* data, size_t dataSize, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped, UploadTicket* uploadTicket)
 {
+	UploadBatch batch(_uploadManager);
+	AllocatedImage new_image = create_image(batch, data, dataSize, size, format, usage, mipmapped);
 
-	//size_t data_size = size.depth * size.width * size.height * get_channel_count(format);
-	size_t data_size = dataSize;
-	AllocatedBuffer uploadbuffer = create_buffer(data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	UploadTicket ticket = batch.submit();
+	if (uploadTicket) { *uploadTicket = ticket; }
 
-	memcpy(uploadbuffer.info.pMappedData, data, data_size);
+	return new_image;
+}
 
+AllocatedImage MainEngine::create_image(UploadBatch& batch, void* data, size_t dataSize, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped)
+{
 	AllocatedImage new_image = create_image(size, format, usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, mipmapped);
-
-	immediate_submit([&](VkCommandBuffer cmd) {
-		vkutil::transition_image(cmd, new_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-		VkBufferImageCopy copyRegion = {};
-		copyRegion.bufferOffset = 0;
-		copyRegion.bufferRowLength = 0;
-		copyRegion.bufferImageHeight = 0;
-
-		copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		copyRegion.imageSubresource.mipLevel = 0;
-		copyRegion.imageSubresource.baseArrayLayer = 0;
-		copyRegion.imageSubresource.layerCount = 1;
-		copyRegion.imageExtent = size;
-
-		// copy the buffer into the image
-		vkCmdCopyBufferToImage(cmd, uploadbuffer.buffer, new_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-			&copyRegion);
-
-		if (mipmapped) {
-			vkutil::generate_mipmaps(cmd, new_image.image, VkExtent2D{ new_image.imageExtent.width,new_image.imageExtent.height });
-		}
-		else {
-			vkutil::transition_image(cmd, new_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		}
-		});
-
-	destroy_buffer(uploadbuffer);
-
+	batch.upload_image(new_image, data, dataSize, mipmapped);
 	return new_image;
 }
 
@@ -815,6 +1370,14 @@ void MainEngine::destroy_image(const AllocatedImage& img)
 {
 	vkDestroyImageView(_device, img.imageView, nullptr);
 	vmaDestroyImage(_allocator, img.image, img.allocation);
+	invalidate_descriptor_caches();
+}
+
+void MainEngine::retire_image(ImageHandle image)
+{
+	unregister_bindless_image(image);
+	// held back while the defragmenter is moving it
+	_defragmenter.retire_image(image, get_current_frame()._deletionQueue);
 }
 
 int MainEngine::get_channel_count(VkFormat format)
@@ -848,31 +1411,61 @@ AllocatedBuffer MainEngine::create_buffer(size_t allocSize, VkBufferUsageFlags u
 
 	vmaallocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
 	AllocatedBuffer newBuffer{};
+	newBuffer.usage = usage;
+	newBuffer.size = allocSize;
 
-
-	VK_CHECK(vmaCreateBuffer(_allocator, &bufferInfo, &vmaallocInfo, &newBuffer.buffer, &newBuffer.allocation,
-		&newBuffer.info));
+	// host visible buffers of unknown lifetime stay in the default pools
+	if (memoryUsage == VMA_MEMORY_USAGE_GPU_ONLY) {
+		VK_CHECK(_memoryPools.create_buffer(MemoryClass::Buffers, bufferInfo, vmaallocInfo, newBuffer));
+	}
+	else {
+		VK_CHECK(vmaCreateBuffer(_allocator, &bufferInfo, &vmaallocInfo, &newBuffer.buffer, &newBuffer.allocation,
+			&newBuffer.info));
+	}
 
 	return newBuffer;
 }
 
-AllocatedBuffer MainEngine::create_staging_buffer(size_t allocSize)
+AllocatedBuffer MainEngine::create_buffer(const void* data, size_t dataSize, VkBufferUsageFlags usage, UploadTicket* uploadTicket)
 {
-	return create_buffer(allocSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.pNext = nullptr;
+	bufferInfo.size = dataSize;
+	// transfer dst for when the allocation doesn't end up host visible, transfer src so it can be defragmented
+	bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+	VmaAllocationCreateInfo vmaallocInfo = {};
+	vmaallocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+	vmaallocInfo.flags = _uploadManager.get_device_buffer_flags();
+	AllocatedBuffer newBuffer{};
+	VK_CHECK(_memoryPools.create_buffer(MemoryClass::UploadBuffers, bufferInfo, vmaallocInfo, newBuffer));
+
+	UploadTicket ticket = _uploadManager.upload_buffer(newBuffer, data, dataSize);
+	if (uploadTicket) { *uploadTicket = ticket; }
+
+	return newBuffer;
 }
 
-void MainEngine::copy_buffer(AllocatedBuffer src, AllocatedBuffer dst, VkDeviceSize size)
+AllocatedBuffer MainEngine::create_staging_buffer(size_t allocSize)
 {
+	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.pNext = nullptr;
+	bufferInfo.size = allocSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 
-	immediate_submit([&](VkCommandBuffer cmd) {
-		VkBufferCopy vertexCopy{ 0 };
-		vertexCopy.dstOffset = 0;
-		vertexCopy.srcOffset = 0;
-		vertexCopy.size = size;
+	VmaAllocationCreateInfo vmaallocInfo = {};
+	vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	vmaallocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
 
-		vkCmdCopyBuffer(cmd, src.buffer, dst.buffer, 1, &vertexCopy);
-		});
+	// staging is freed within a few frames, the linear staging pool keeps it out of long lived blocks
+	AllocatedBuffer newBuffer{};
+	VK_CHECK(_memoryPools.create_buffer(MemoryClass::Staging, bufferInfo, vmaallocInfo, newBuffer));
+	return newBuffer;
+}
 
+UploadTicket MainEngine::copy_buffer(AllocatedBuffer src, AllocatedBuffer dst, VkDeviceSize size)
+{
+	return _uploadManager.copy_buffer(src, dst, size);
 }
 
 VkDeviceAddress MainEngine::get_buffer_address(AllocatedBuffer buffer)
@@ -887,4 +1480,9 @@ void MainEngine::destroy_buffer(const AllocatedBuffer& buffer)
 {
 	vmaDestroyBuffer(_allocator, buffer.buffer, buffer.allocation);
 }
+
+void MainEngine::retire_buffer(BufferHandle buffer)
+{
+	_defragmenter.retire_buffer(buffer, get_current_frame()._deletionQueue);
+}
 #pragma endregion
\ No newline at end of file
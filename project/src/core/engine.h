@@ -7,8 +7,26 @@
 #include "vk_descriptors.h"
 #include "vk_descriptor_buffer.h"
 #include "vk_pipelines.h"
-
-constexpr unsigned int FRAME_OVERLAP = 2;
+#include "frame_statistics.h"
+#include "vk_profiler.h"
+#include "vk_render_graph.h"
+#include "vk_upload_manager.h"
+#include "vk_frame_allocator.h"
+#include "vk_transient_pool.h"
+#include "vk_deletion_queue.h"
+#include "vk_resources.h"
+#include "vk_defragmenter.h"
+#include "vk_memory_pools.h"
+
+// upper bound for frames in flight, the active count is MainEngine::_frameOverlap
+constexpr unsigned int MAX_FRAME_OVERLAP = 4;
+static_assert(MAX_FRAME_OVERLAP <= VersionedDescriptorSet::MAX_VERSIONS, "a per-frame descriptor set needs a version per frame in flight");
+// transient uniform/storage/indirect data a single frame can allocate
+constexpr VkDeviceSize FRAME_ALLOCATOR_SIZE = 16 * 1024 * 1024;
+// capacity of the bindless heap, clamped to the device's per stage limits
+constexpr uint32_t BINDLESS_MAX_SAMPLED_IMAGES = 16384;
+constexpr uint32_t BINDLESS_MAX_SAMPLERS = 64;
+constexpr uint32_t BINDLESS_MAX_STORAGE_IMAGES = 1024;
 
 
 struct DeletionQueue
@@ -33,10 +51,13 @@ struct FrameData {
 	VkCommandPool _commandPool;
 	VkCommandBuffer _mainCommandBuffer;
 	VkSemaphore _swapchainSemaphore, _renderSemaphore;
-	VkFence _renderFence;
+	// value of MainEngine::_frameTimeline signaled by this frame's last submission
+	uint64_t _timelineValue{ 0 };
 
 	// Frame Lifetime Deletion Queue
-	DeletionQueue _deletionQueue;
+	ResourceDeletionQueue _deletionQueue;
+	// Frame Lifetime Allocations - reset when the slot is reused
+	FrameAllocator _frameAllocator;
 };
 
 
@@ -46,76 +67,170 @@ public:
 	VkDebugUtilsMessengerEXT _debug_messenger;
 	VkPhysicalDevice _physicalDevice;
 	VkDevice _device;
-	VkSurfaceKHR _surface;
+	VkSurfaceKHR _surface{ VK_NULL_HANDLE };
 	VmaAllocator _allocator;
 
 	VkExtent2D _windowExtent{ 1700 , 900 };
 	struct SDL_Window* _window{ nullptr };
 
+	// Headless - no window/surface/swapchain, renders _headlessFrameCount frames (0 = until request_stop())
+	bool _headless{ false };
+	uint32_t _headlessFrameCount{ 0 };
+	std::atomic<bool> _stopRequested{ false };
+	void request_stop();
+
 
 	int _frameNumber{ 0 };
 	float frameTime{ 0.0f };
 	float drawTime{ 0.0f };
 
+	// per-frame CPU timings, dumped to _frameStatisticsPath on exit or from ImGui
+	FrameStatistics _frameStatistics;
+	std::string _frameStatisticsPath{ "frame_statistics.csv" };
+	std::vector<FrameSample> _frameSampleScratch;
+	std::vector<float> _frameStatisticsScratch;
+
+	// GPU timestamps per pass, read back from the retired frame
+	GpuProfiler _gpuProfiler;
+
+	// Memory - per-heap budgets come from VK_EXT_memory_budget when available, VMA estimates them otherwise.
+	//  VMA's JSON statistics are written to _memoryStatsPath from ImGui, or on exit with _dumpMemoryStatsOnExit
+	bool _memoryBudgetSupported{ false };
+	// a VMA pool per resource class, created right after the allocator
+	MemoryPools _memoryPools;
+	std::string _memoryStatsPath{ "memory_stats.json" };
+	bool _dumpMemoryStatsOnExit{ false };
+	bool write_memory_stats(const std::string& path);
+	// moves registry resources to compact VMA's blocks, started from ImGui or when fragmentation builds up
+	GpuDefragmenter _defragmenter;
+	bool _autoDefragment{ true };
+	// compares staged and direct buffer uploads after initialization
+	bool _runUploadBenchmark{ false };
+
+	// Input Latency - SDL_PollEvent timestamp of the oldest input event not yet presented, to vkQueuePresentKHR
+	uint64_t _pendingInputCounter{ 0 };
+	float inputLatency{ 0.0f };
+	float averageInputLatency{ 0.0f };
+
 	// Graphics Queue Family
-	FrameData _frames[FRAME_OVERLAP];
-	FrameData& get_current_frame() { return _frames[_frameNumber % FRAME_OVERLAP]; };
+	// frames in flight (1 - MAX_FRAME_OVERLAP). set before init(), use set_frame_overlap() at runtime
+	uint32_t _frameOverlap{ 2 };
+	uint32_t _pendingFrameOverlap{ 0 };
+	FrameData _frames[MAX_FRAME_OVERLAP];
+	FrameData& get_current_frame() { return _frames[_frameNumber % _frameOverlap]; };
+	void set_frame_overlap(uint32_t frameOverlap);
 	VkQueue _graphicsQueue;
 	uint32_t _graphicsQueueFamily;
+	// dedicated transfer queue, VK_NULL_HANDLE if the device has none
+	VkQueue _transferQueue{ VK_NULL_HANDLE };
+	uint32_t _transferQueueFamily{ 0 };
+
+	// Frame Timeline - frame N signals value N + 1 when its GPU work retires
+	VkSemaphore _frameTimeline;
+	uint64_t get_frame_timeline_value(int frameNumber) { return static_cast<uint64_t>(frameNumber) + 1; };
+	uint64_t get_retired_frame_value();
+	bool is_frame_retired(uint64_t frameValue) { return get_retired_frame_value() >= frameValue; };
+	void wait_for_frame_retired(uint64_t frameValue, uint64_t timeout = 1000000000);
 
 	DeletionQueue _mainDeletionQueue;
 
+	// images and buffers referenced by handle
+	ResourceRegistry _resources;
+
 	//draw resources
-	AllocatedImage _drawImage;
-	AllocatedImage _drawImageBeforeMSAA;
-	AllocatedImage _depthImage;
+	ImageHandle _drawImage{};
+	ImageHandle _drawImageBeforeMSAA{};
+	ImageHandle _depthImage{};
+	// owns the draw images' memory. their pass ranges all overlap, so nothing is aliased at the moment,
+	//  the pool only puts transient attachments into lazily allocated memory where the device has it
+	TransientImagePool _transientImages;
 	VkExtent2D _drawExtent;
 	float _renderScale{ 1.0f };
 	float _maxRenderScale{ 1.0f };
 
+	// rebuilt every frame in draw()
+	RenderGraph _renderGraph;
+
 	// Swapchain
-	VkSwapchainKHR _swapchain;
+	VkSwapchainKHR _swapchain{ VK_NULL_HANDLE };
 	VkFormat _swapchainImageFormat;
 	std::vector<VkImage> _swapchainImages;
 	std::vector<VkImageView> _swapchainImageViews;
 	VkExtent2D _swapchainExtent;
+	bool resize_requested{ false };
 
-	// immediate submit structures
-	VkFence _immFence;
-	VkCommandBuffer _immCommandBuffer;
-	VkCommandPool _immCommandPool;
-	void immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function);
+	// Present Mode - requested mode falls back to what the surface supports (FIFO is always available)
+	VkPresentModeKHR _requestedPresentMode{ VK_PRESENT_MODE_FIFO_KHR };
+	VkPresentModeKHR _presentMode{ VK_PRESENT_MODE_FIFO_KHR };
+	std::vector<VkPresentModeKHR> _supportedPresentModes;
+	void set_present_mode(VkPresentModeKHR presentMode);
+
+	// Frame Limiter - 0 is uncapped. Low latency mode waits for the limiter and the frame slot before sampling input
+	float _targetFrameRate{ 0.0f };
+	bool _lowLatencyMode{ false };
+	std::chrono::steady_clock::time_point _nextFrameDeadline{};
+
+	// asynchronous uploads, on the transfer queue if the device has a dedicated one
+	UploadManager _uploadManager;
 
 	// Dear ImGui
 	VkDescriptorPool imguiPool;
 
 	// Default textures/samplers
-	AllocatedImage _whiteImage;
-	AllocatedImage _blackImage;
-	AllocatedImage _greyImage;
-	AllocatedImage _errorCheckerboardImage;
+	ImageHandle _whiteImage;
+	ImageHandle _blackImage;
+	ImageHandle _greyImage;
+	ImageHandle _errorCheckerboardImage;
 	VkSampler _defaultSamplerLinear;
 	VkSampler _defaultSamplerNearest;
 
+#pragma region Bindless
+	// one descriptor buffer holding every texture, sampler and storage image, see shaders/include/bindless.glsl
+	VkDescriptorSetLayout _bindlessDescriptorSetLayout;
+	DescriptorBufferBindless _bindlessHeap;
+	// an image's heap index is its handle's index. the registered handle per index, null where nothing is registered
+	std::vector<ImageHandle> _bindlessImages;
+	uint32_t _bindlessSamplerNearest{ DescriptorBufferBindless::INVALID_INDEX };
+	uint32_t _bindlessSamplerLinear{ DescriptorBufferBindless::INVALID_INDEX };
+	// returns the index shaders sample the image with (the handle's index), registering it on first use
+	uint32_t register_bindless_image(ImageHandle image);
+	// frames still in flight must no longer sample the index
+	void unregister_bindless_image(ImageHandle image);
+	uint32_t get_bindless_index(ImageHandle image) const;
+#pragma endregion
+
 #pragma region Images
 	AllocatedImage create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
-	AllocatedImage create_image(void* data, size_t dataSize, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
+	// returns immediately, the image can be sampled by frames recorded after uploadTicket is acquired
+	AllocatedImage create_image(void* data, size_t dataSize, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false, UploadTicket* uploadTicket = nullptr);
+	// the upload is part of batch and completes with the batch's ticket
+	AllocatedImage create_image(UploadBatch& batch, void* data, size_t dataSize, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
 	int get_channel_count(VkFormat format);
+	// immediately, for images no frame uses that were never registered or that were removed after _defragmenter.destroy()
 	void destroy_image(const AllocatedImage& img);
+	// removes a registered image (and its bindless index) and destroys it once frames in flight are done with it
+	void retire_image(ImageHandle image);
 #pragma endregion
 
 #pragma region VkBuffers
 	AllocatedBuffer create_buffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
+	// device local buffer filled with data, written directly when the device has host visible VRAM (uploadTicket is 0 then)
+	AllocatedBuffer create_buffer(const void* data, size_t dataSize, VkBufferUsageFlags usage, UploadTicket* uploadTicket = nullptr);
 	AllocatedBuffer create_staging_buffer(size_t allocSize);
-	void copy_buffer(AllocatedBuffer src, AllocatedBuffer dst, VkDeviceSize size);
+	// src must stay alive until the returned ticket completes
+	UploadTicket copy_buffer(AllocatedBuffer src, AllocatedBuffer dst, VkDeviceSize size);
 	VkDeviceAddress get_buffer_address(AllocatedBuffer buffer);
 	void destroy_buffer(const AllocatedBuffer& buffer);
+	// removes a registered buffer and destroys it once frames in flight are done with it
+	void retire_buffer(BufferHandle buffer);
 #pragma endregion
 
 
 	VkPipelineLayout _fullscreenPipelineLayout;
 	VkDescriptorSetLayout _fullscreenDescriptorSetLayout;
 	DescriptorBufferSampler _fullscreenDescriptorBuffer;
+	// rewritten every frame with the source image
+	VersionedDescriptorSet _fullscreenDescriptorSet;
 	ShaderObject _fullscreenPipeline;
 
 	void init();
@@ -129,20 +244,36 @@ private:
 	void init_swapchain();
 	void init_commands();
 	void init_sync_structures();
+	void init_frame_allocators();
 	void init_default_data();
+	void init_bindless();
 
 	void init_dearimgui();
 	void layout_imgui();
+	void layout_frame_statistics();
+	void layout_gpu_timings();
+	void layout_memory_budget();
 	void draw_imgui(VkCommandBuffer cmd, VkImageView targetImageView);
 
-	void draw_fullscreen(VkCommandBuffer cmd, AllocatedImage sourceImage, AllocatedImage targetImage);
+	void draw_fullscreen(VkCommandBuffer cmd, ImageHandle sourceImage, ImageHandle targetImage);
+
+	void apply_frame_overlap();
+	// call after image views or samplers were destroyed, the driver may hand their handles out again
+	void invalidate_descriptor_caches();
 
 	void init_pipeline();
 
 
+	void run_headless();
+	void wait_for_frame_limit();
+
+	VkPresentModeKHR choose_present_mode(VkPresentModeKHR requested);
+	void resize_swapchain();
 	void create_swapchain(uint32_t width, uint32_t height);
 	void create_draw_images(uint32_t width, uint32_t height);
-	void destroy_swapchain();
+	void destroy_swapchain(VkSwapchainKHR swapchain, const std::vector<VkImageView>& imageViews);
+	// the handles of the draw images, their memory stays with _transientImages
+	void unregister_draw_images();
 	void destroy_draw_iamges();
 };
 
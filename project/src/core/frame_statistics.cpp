@@ -0,0 +1,60 @@
+#include "frame_statistics.h"
+
+void FrameStatistics::push(const FrameSample& sample)
+{
+	uint64_t index = _writeIndex.load(std::memory_order_relaxed);
+	_samples[index % CAPACITY] = sample;
+	_writeIndex.store(index + 1, std::memory_order_release);
+}
+
+void FrameStatistics::snapshot(std::vector<FrameSample>& out) const
+{
+	out.clear();
+	uint64_t end = _writeIndex.load(std::memory_order_acquire);
+	uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+	out.reserve(static_cast<size_t>(end - begin));
+	for (uint64_t i = begin; i < end; i++) {
+		out.push_back(_samples[i % CAPACITY]);
+	}
+
+	// anything the producer wrapped around onto during the copy may be torn, drop it.
+	//  index latest may be mid-write, and it shares its slot with latest - CAPACITY
+	uint64_t latest = _writeIndex.load(std::memory_order_acquire);
+	uint64_t firstValid = latest + 1 > CAPACITY ? latest + 1 - CAPACITY : 0;
+	if (firstValid > begin) {
+		size_t overwritten = static_cast<size_t>(std::min(firstValid - begin, end - begin));
+		out.erase(out.begin(), out.begin() + overwritten);
+	}
+}
+
+FramePercentiles FrameStatistics::percentiles(std::vector<float>& values)
+{
+	if (values.empty()) { return { 0.0f, 0.0f, 0.0f }; }
+	std::sort(values.begin(), values.end());
+	auto at = [&](float percentile) {
+		size_t index = static_cast<size_t>(percentile * (values.size() - 1) + 0.5f);
+		return values[index];
+		};
+	return { at(0.50f), at(0.95f), at(0.99f) };
+}
+
+bool FrameStatistics::write_csv(const std::string& path) const
+{
+	std::vector<FrameSample> samples;
+	snapshot(samples);
+
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		fmt::print("Failed to open {} for writing frame statistics\n", path);
+		return false;
+	}
+
+	file << "frame,acquire_wait_ms,record_ms,submit_ms,present_ms,frame_ms\n";
+	for (const FrameSample& s : samples) {
+		file << fmt::format("{},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f}\n"
+			, s.frameNumber, s.acquireWait, s.record, s.submit, s.present, s.frame);
+	}
+
+	fmt::print("Wrote {} frame samples to {}\n", samples.size(), path);
+	return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "big_header.h"
+
+// CPU timings of one frame in milliseconds
+struct FrameSample {
+	uint64_t frameNumber;
+	float acquireWait; // frame slot timeline wait + swapchain acquire
+	float record;
+	float submit;
+	float present;
+	float frame;
+};
+
+struct FramePercentiles {
+	float p50;
+	float p95;
+	float p99;
+};
+
+// Fixed size ring buffer of the most recent frame samples.
+//  Single producer (the render loop) and lock-free readers: a reader copies the samples it wants
+//  and discards any the producer may have overwritten while it was copying.
+class FrameStatistics {
+public:
+	static constexpr uint32_t CAPACITY = 1024;
+
+	void push(const FrameSample& sample);
+	// copies up to CAPACITY samples into out, oldest first
+	void snapshot(std::vector<FrameSample>& out) const;
+
+	// sorts values in place
+	static FramePercentiles percentiles(std::vector<float>& values);
+
+	bool write_csv(const std::string& path) const;
+
+private:
+	std::array<FrameSample, CAPACITY> _samples{};
+	std::atomic<uint64_t> _writeIndex{ 0 };
+};
@@ -1,10 +1,68 @@
 #include "engine.h"
+#include "benchmarks.h"
+#include <csignal>
+
+static MainEngine* runningEngine{ nullptr };
 
 int main(int argc, char* argv[]) 
 {
 
 	MainEngine engine;
 
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--frames-in-flight" && i + 1 < argc) {
+			engine._frameOverlap = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (arg == "--present-mode" && i + 1 < argc) {
+			std::string mode = argv[++i];
+			if (mode == "immediate") { engine._requestedPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR; }
+			else if (mode == "mailbox") { engine._requestedPresentMode = VK_PRESENT_MODE_MAILBOX_KHR; }
+			else if (mode == "fifo_relaxed") { engine._requestedPresentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR; }
+			else if (mode == "fifo") { engine._requestedPresentMode = VK_PRESENT_MODE_FIFO_KHR; }
+			else {
+				fmt::print("Unknown present mode '{}', expected one of: fifo, fifo_relaxed, mailbox, immediate\n", mode);
+				return 1;
+			}
+		}
+		else if (arg == "--fps-cap" && i + 1 < argc) {
+			engine._targetFrameRate = static_cast<float>(std::atof(argv[++i]));
+		}
+		else if (arg == "--low-latency") {
+			engine._lowLatencyMode = true;
+		}
+		else if (arg == "--headless") {
+			engine._headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			engine._headlessFrameCount = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+		else if (arg == "--frame-stats" && i + 1 < argc) {
+			engine._frameStatisticsPath = argv[++i];
+		}
+		else if (arg == "--memory-stats" && i + 1 < argc) {
+			engine._memoryStatsPath = argv[++i];
+			engine._dumpMemoryStatsOnExit = true;
+		}
+		else if (arg == "--benchmark-uploads") {
+			engine._runUploadBenchmark = true;
+		}
+		else if (arg == "--benchmark") {
+			benchmarks::run_all();
+			return 0;
+		}
+		else if (arg == "--extent" && i + 2 < argc) {
+			engine._windowExtent.width = static_cast<uint32_t>(std::atoi(argv[++i]));
+			engine._windowExtent.height = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+	}
+
+	// ctrl+c stops a headless run cleanly, windowed runs are closed through SDL
+	if (engine._headless) {
+		runningEngine = &engine;
+		std::signal(SIGINT, [](int) { if (runningEngine) { runningEngine->request_stop(); } });
+	}
+
 	engine.init();
 
 	engine.run();
@@ -12,4 +70,4 @@ int main(int argc, char* argv[])
 	engine.cleanup();
 
 	return 0;
-}
\ No newline at end of file
+}
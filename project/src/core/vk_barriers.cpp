@@ -0,0 +1,128 @@
+#include "vk_barriers.h"
+
+vkutil::LayoutSync vkutil::get_src_layout_sync(VkImageLayout layout)
+{
+	switch (layout) {
+	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+		return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT };
+	case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL:
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT
+			, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+	case VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL:
+		return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_NONE };
+	case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+		return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_NONE };
+	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+		return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT };
+	default:
+		// GENERAL and anything else can be used by any stage. an UNDEFINED/PRESENT_SRC image may be reused, so the
+		//  layout says nothing about its last writer. pass NONE explicitly for images known to be fresh
+		return { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT };
+	}
+}
+
+vkutil::LayoutSync vkutil::get_dst_layout_sync(VkImageLayout layout)
+{
+	switch (layout) {
+	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+		return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT
+			, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT };
+	case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL:
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT
+			, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+	case VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL:
+		return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT };
+	case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+		return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT };
+	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+		return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT };
+	case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+		return { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE };
+	default:
+		return { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT };
+	}
+}
+
+VkImageSubresourceRange vkutil::subresource_range(VkImageAspectFlags aspectMask, uint32_t baseMipLevel, uint32_t levelCount
+	, uint32_t baseArrayLayer, uint32_t layerCount)
+{
+	VkImageSubresourceRange range{};
+	range.aspectMask = aspectMask;
+	range.baseMipLevel = baseMipLevel;
+	range.levelCount = levelCount;
+	range.baseArrayLayer = baseArrayLayer;
+	range.layerCount = layerCount;
+	return range;
+}
+
+vkutil::BarrierBuilder& vkutil::BarrierBuilder::image(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout
+	, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess
+	, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess
+	, VkImageSubresourceRange range
+	, uint32_t srcQueueFamily, uint32_t dstQueueFamily)
+{
+	VkImageMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2, .pNext = nullptr };
+	barrier.srcStageMask = srcStage;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstStageMask = dstStage;
+	barrier.dstAccessMask = dstAccess;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = srcQueueFamily;
+	barrier.dstQueueFamilyIndex = dstQueueFamily;
+	barrier.image = image;
+	barrier.subresourceRange = range;
+	_imageBarriers.push_back(barrier);
+	return *this;
+}
+
+vkutil::BarrierBuilder& vkutil::BarrierBuilder::image(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, VkImageSubresourceRange range)
+{
+	LayoutSync src = get_src_layout_sync(oldLayout);
+	LayoutSync dst = get_dst_layout_sync(newLayout);
+	return this->image(image, oldLayout, newLayout, src.stage, src.access, dst.stage, dst.access, range);
+}
+
+vkutil::BarrierBuilder& vkutil::BarrierBuilder::buffer(VkBuffer buffer
+	, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess
+	, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess
+	, VkDeviceSize offset, VkDeviceSize size
+	, uint32_t srcQueueFamily, uint32_t dstQueueFamily)
+{
+	VkBufferMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2, .pNext = nullptr };
+	barrier.srcStageMask = srcStage;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstStageMask = dstStage;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = srcQueueFamily;
+	barrier.dstQueueFamilyIndex = dstQueueFamily;
+	barrier.buffer = buffer;
+	barrier.offset = offset;
+	barrier.size = size;
+	_bufferBarriers.push_back(barrier);
+	return *this;
+}
+
+void vkutil::BarrierBuilder::clear()
+{
+	_imageBarriers.clear();
+	_bufferBarriers.clear();
+}
+
+void vkutil::BarrierBuilder::flush(VkCommandBuffer cmd)
+{
+	if (empty()) { return; }
+
+	VkDependencyInfo depInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .pNext = nullptr };
+	depInfo.imageMemoryBarrierCount = static_cast<uint32_t>(_imageBarriers.size());
+	depInfo.pImageMemoryBarriers = _imageBarriers.data();
+	depInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(_bufferBarriers.size());
+	depInfo.pBufferMemoryBarriers = _bufferBarriers.data();
+	vkCmdPipelineBarrier2(cmd, &depInfo);
+
+	clear();
+}
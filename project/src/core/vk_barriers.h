@@ -0,0 +1,47 @@
+#pragma once
+#include "big_header.h"
+#include "vk_initializers.h"
+
+namespace vkutil {
+	// stage/access an image layout is typically used with, for deriving barrier masks from layouts
+	struct LayoutSync {
+		VkPipelineStageFlags2 stage;
+		VkAccessFlags2 access;
+	};
+	// as the source of a barrier, only the writes of the previous usage. UNDEFINED, PREINITIALIZED and PRESENT_SRC
+	//  wait for all prior commands
+	LayoutSync get_src_layout_sync(VkImageLayout layout);
+	// as the destination of a barrier, every access of the next usage
+	LayoutSync get_dst_layout_sync(VkImageLayout layout);
+
+	VkImageSubresourceRange subresource_range(VkImageAspectFlags aspectMask, uint32_t baseMipLevel, uint32_t levelCount
+		, uint32_t baseArrayLayer = 0, uint32_t layerCount = VK_REMAINING_ARRAY_LAYERS);
+
+	// Accumulates image and buffer barriers and records them with a single vkCmdPipelineBarrier2.
+	//  Queue family indices other than VK_QUEUE_FAMILY_IGNORED make the barrier an ownership release/acquire.
+	class BarrierBuilder {
+	public:
+		BarrierBuilder& image(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout
+			, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess
+			, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess
+			, VkImageSubresourceRange range
+			, uint32_t srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
+		// stage/access masks derived from the layouts
+		BarrierBuilder& image(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, VkImageSubresourceRange range);
+
+		BarrierBuilder& buffer(VkBuffer buffer
+			, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess
+			, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess
+			, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE
+			, uint32_t srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
+
+		bool empty() const { return _imageBarriers.empty() && _bufferBarriers.empty(); }
+		void clear();
+		// records every accumulated barrier and clears the builder
+		void flush(VkCommandBuffer cmd);
+
+	private:
+		std::vector<VkImageMemoryBarrier2> _imageBarriers;
+		std::vector<VkBufferMemoryBarrier2> _bufferBarriers;
+	};
+}
@@ -0,0 +1,285 @@
+#include "vk_defragmenter.h"
+
+// movable images are only ever sampled, so they are always in this layout outside of a move
+constexpr VkImageLayout MOVABLE_IMAGE_LAYOUT = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+constexpr VkImageUsageFlags MOVABLE_IMAGE_USAGE = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+constexpr VkImageUsageFlags UNMOVABLE_IMAGE_USAGE = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+constexpr VkBufferUsageFlags MOVABLE_BUFFER_USAGE = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+void GpuDefragmenter::init(VkDevice device, VmaAllocator allocator, ResourceRegistry* registry, std::vector<VmaPool> pools)
+{
+	_device = device;
+	_allocator = allocator;
+	_registry = registry;
+	_pools = std::move(pools);
+}
+
+void GpuDefragmenter::destroy(ResourceDeletionQueue& deletionQueue)
+{
+	if (!is_running()) { return; }
+	// no further pools are started
+	_pools.resize(_poolIndex + 1);
+	if (_passState != PassState::None && !end_pass(deletionQueue)) { return; }
+	finish();
+}
+
+bool GpuDefragmenter::begin()
+{
+	if (is_running() || _pools.empty()) { return false; }
+
+	_poolIndex = 0;
+	_runStats = {};
+	start_pool();
+	return true;
+}
+
+void GpuDefragmenter::start_pool()
+{
+	VmaDefragmentationInfo info{};
+	info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+	info.pool = _pools[_poolIndex];
+	info.maxBytesPerPass = MAX_BYTES_PER_PASS;
+	info.maxAllocationsPerPass = MAX_MOVES_PER_PASS;
+	VK_CHECK(vmaBeginDefragmentation(_allocator, &info, &_context));
+}
+
+float GpuDefragmenter::get_fragmentation(VkDeviceSize* reclaimableBytes) const
+{
+	VmaTotalStatistics stats;
+	vmaCalculateStatistics(_allocator, &stats);
+	VkDeviceSize blockBytes = stats.total.statistics.blockBytes;
+	VkDeviceSize unusedBytes = blockBytes - stats.total.statistics.allocationBytes;
+	if (reclaimableBytes) { *reclaimableBytes = unusedBytes; }
+	return blockBytes > 0 ? static_cast<float>(unusedBytes) / blockBytes : 0.0f;
+}
+
+bool GpuDefragmenter::should_defragment() const
+{
+	VkDeviceSize reclaimableBytes;
+	float fragmentation = get_fragmentation(&reclaimableBytes);
+	return fragmentation > FRAGMENTATION_THRESHOLD && reclaimableBytes >= MIN_RECLAIMABLE_BYTES;
+}
+
+void GpuDefragmenter::update(VkCommandBuffer cmd, uint64_t frameValue, uint64_t retiredFrameValue, bool allowMoves, ResourceDeletionQueue& deletionQueue)
+{
+	_passChanged = false;
+	_viewsDestroyed = false;
+	if (!is_running()) { return; }
+
+	// one pass in flight at a time
+	if (_passState != PassState::None) {
+		if (retiredFrameValue < _passFrameValue) { return; }
+		// the copies are done and no frame recorded before the move is left. frames still on the queue may sample
+		//  the old images through long lived descriptors, so those stay until the frame rewriting them retires
+		if (_passState == PassState::Recorded && !_passImages.empty()) {
+			_passState = PassState::Copied;
+			_passChanged = true;
+			_passFrameValue = frameValue;
+			return;
+		}
+		if (!end_pass(deletionQueue)) { return; }
+	}
+	if (!allowMoves) { return; }
+
+	VkResult result = vmaBeginDefragmentationPass(_allocator, _context, &_passInfo);
+	if (result == VK_SUCCESS) {
+		finish();
+		return;
+	}
+	if (result != VK_INCOMPLETE) { VK_CHECK(result); }
+
+	for (uint32_t i = 0; i < _passInfo.moveCount; i++) {
+		VmaDefragmentationMove& move = _passInfo.pMoves[i];
+		bool recorded = false;
+		if (ImageHandle image = _registry->find_image(move.srcAllocation); !image.is_null()) {
+			recorded = record_image_move(move, image);
+		}
+		else if (BufferHandle buffer = _registry->find_buffer(move.srcAllocation); !buffer.is_null()) {
+			recorded = record_buffer_move(move, buffer);
+		}
+		// VMA frees the temporary destination and leaves the allocation where it is
+		if (!recorded) { move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE; }
+	}
+
+	if (_passImages.empty() && _passBuffers.empty()) {
+		// nothing to wait for, the ignored moves are handed back immediately
+		end_pass(deletionQueue);
+		return;
+	}
+
+	_preCopyBarriers.flush(cmd);
+	for (size_t i = 0; i < _passImages.size(); i++) {
+		ImageHandle handle = _passImages[i];
+		VkExtent3D extent = _registry->get_image_extent(handle);
+		uint32_t mipLevels = _registry->get_image_mip_levels(handle);
+		std::array<VkImageCopy, 16> regions{};
+		for (uint32_t mip = 0; mip < mipLevels; mip++) {
+			VkImageCopy& region = regions[mip];
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1 };
+			region.dstSubresource = region.srcSubresource;
+			region.extent = { std::max(extent.width >> mip, 1u), std::max(extent.height >> mip, 1u), std::max(extent.depth >> mip, 1u) };
+		}
+		vkCmdCopyImage(cmd, _oldImages[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _registry->get_image(handle)
+			, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, regions.data());
+	}
+	for (size_t i = 0; i < _passBuffers.size(); i++) {
+		BufferHandle handle = _passBuffers[i];
+		VkBufferCopy region{ 0, 0, _registry->get_buffer_size(handle) };
+		vkCmdCopyBuffer(cmd, _oldBuffers[i], _registry->get_buffer(handle), 1, &region);
+	}
+	_postCopyBarriers.flush(cmd);
+
+	_passState = PassState::Recorded;
+	_passChanged = true;
+	_passFrameValue = frameValue;
+}
+
+bool GpuDefragmenter::record_image_move(VmaDefragmentationMove& move, ImageHandle handle)
+{
+	VkImageUsageFlags usage = _registry->get_image_usage(handle);
+	uint32_t mipLevels = _registry->get_image_mip_levels(handle);
+	if ((usage & MOVABLE_IMAGE_USAGE) != MOVABLE_IMAGE_USAGE || (usage & UNMOVABLE_IMAGE_USAGE) != 0) { return false; }
+	// a full mip chain of a 64k texture has 17 levels
+	if (mipLevels > 16) { return false; }
+
+	VkFormat format = _registry->get_image_format(handle);
+	VkImageCreateInfo imageInfo = vkinit::image_create_info(format, usage, _registry->get_image_extent(handle));
+	imageInfo.mipLevels = mipLevels;
+	VkImage newImage;
+	VK_CHECK(vkCreateImage(_device, &imageInfo, nullptr, &newImage));
+	VK_CHECK(vmaBindImageMemory(_allocator, move.dstTmpAllocation, newImage));
+
+	VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(format, newImage, VK_IMAGE_ASPECT_COLOR_BIT);
+	viewInfo.subresourceRange.levelCount = mipLevels;
+	VkImageView newView;
+	VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &newView));
+
+	VkImage oldImage = _registry->get_image(handle);
+	_oldImages.push_back(oldImage);
+	_oldImageViews.push_back(_registry->get_image_view(handle));
+	_registry->replace_image(handle, newImage, newView);
+	_passImages.push_back(handle);
+
+	VkImageSubresourceRange range = vkutil::subresource_range(VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels);
+	// earlier frames on the queue may still be sampling the old image
+	_preCopyBarriers.image(oldImage, MOVABLE_IMAGE_LAYOUT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+		, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_NONE
+		, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, range);
+	_preCopyBarriers.image(newImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+		, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE
+		, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, range);
+	_postCopyBarriers.image(newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, MOVABLE_IMAGE_LAYOUT
+		, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT
+		, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, range);
+	// sampled through the bindless heap until it is rewritten to the new view
+	_postCopyBarriers.image(oldImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, MOVABLE_IMAGE_LAYOUT
+		, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_NONE
+		, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, range);
+	return true;
+}
+
+bool GpuDefragmenter::record_buffer_move(VmaDefragmentationMove& move, BufferHandle handle)
+{
+	VkBufferUsageFlags usage = _registry->get_buffer_usage(handle);
+	if ((usage & MOVABLE_BUFFER_USAGE) != MOVABLE_BUFFER_USAGE || (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0) { return false; }
+	// mapped pointers held by the host would dangle
+	VkMemoryPropertyFlags memoryFlags;
+	vmaGetAllocationMemoryProperties(_allocator, move.srcAllocation, &memoryFlags);
+	if (memoryFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) { return false; }
+
+	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.size = _registry->get_buffer_size(handle);
+	bufferInfo.usage = usage;
+	VkBuffer newBuffer;
+	VK_CHECK(vkCreateBuffer(_device, &bufferInfo, nullptr, &newBuffer));
+	VK_CHECK(vmaBindBufferMemory(_allocator, move.dstTmpAllocation, newBuffer));
+
+	VkBuffer oldBuffer = _registry->get_buffer(handle);
+	_oldBuffers.push_back(oldBuffer);
+	_registry->replace_buffer(handle, newBuffer);
+	_passBuffers.push_back(handle);
+
+	_preCopyBarriers.buffer(oldBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT
+		, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+	_postCopyBarriers.buffer(newBuffer, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT
+		, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT);
+	return true;
+}
+
+void GpuDefragmenter::retire_image(ImageHandle handle, ResourceDeletionQueue& deletionQueue)
+{
+	if (in_pass(_registry->get_image_allocation(handle))) {
+		_retiredImages.push_back(handle);
+		return;
+	}
+	_registry->retire_image(handle, deletionQueue);
+}
+
+void GpuDefragmenter::retire_buffer(BufferHandle handle, ResourceDeletionQueue& deletionQueue)
+{
+	if (in_pass(_registry->get_buffer_allocation(handle))) {
+		_retiredBuffers.push_back(handle);
+		return;
+	}
+	_registry->retire_buffer(handle, deletionQueue);
+}
+
+bool GpuDefragmenter::in_pass(VmaAllocation allocation) const
+{
+	if (_passState == PassState::None || allocation == VK_NULL_HANDLE) { return false; }
+	for (uint32_t i = 0; i < _passInfo.moveCount; i++) {
+		if (_passInfo.pMoves[i].srcAllocation == allocation) { return true; }
+	}
+	return false;
+}
+
+bool GpuDefragmenter::end_pass(ResourceDeletionQueue& deletionQueue)
+{
+	for (VkImageView view : _oldImageViews) { vkDestroyImageView(_device, view, nullptr); }
+	_viewsDestroyed = !_oldImageViews.empty();
+	for (VkImage image : _oldImages) { vkDestroyImage(_device, image, nullptr); }
+	for (VkBuffer buffer : _oldBuffers) { vkDestroyBuffer(_device, buffer, nullptr); }
+	_oldImageViews.clear();
+	_oldImages.clear();
+	_oldBuffers.clear();
+	_passImages.clear();
+	_passBuffers.clear();
+	_passState = PassState::None;
+	_passFrameValue = 0;
+
+	// the moved allocations now point at their new memory, the memory left behind is freed
+	VkResult result = vmaEndDefragmentationPass(_allocator, _context, &_passInfo);
+	// frames recorded until now may still use them, deletionQueue is the latest frame's
+	for (ImageHandle handle : _retiredImages) { _registry->retire_image(handle, deletionQueue); }
+	for (BufferHandle handle : _retiredBuffers) { _registry->retire_buffer(handle, deletionQueue); }
+	_retiredImages.clear();
+	_retiredBuffers.clear();
+	if (result == VK_SUCCESS) {
+		finish();
+		return false;
+	}
+	if (result != VK_INCOMPLETE) { VK_CHECK(result); }
+	return true;
+}
+
+void GpuDefragmenter::finish()
+{
+	VmaDefragmentationStats stats;
+	vmaEndDefragmentation(_allocator, _context, &stats);
+	_context = VK_NULL_HANDLE;
+	_runStats.bytesMoved += stats.bytesMoved;
+	_runStats.bytesFreed += stats.bytesFreed;
+	_runStats.allocationsMoved += stats.allocationsMoved;
+	_runStats.deviceMemoryBlocksFreed += stats.deviceMemoryBlocksFreed;
+
+	if (++_poolIndex < _pools.size()) {
+		start_pool();
+		return;
+	}
+
+	_lastStats = _runStats;
+	_completedCount++;
+	fmt::print("Defragmentation: moved {} allocations ({:.1f} MB), freed {:.1f} MB in {} blocks\n"
+		, _lastStats.allocationsMoved, _lastStats.bytesMoved / (1024.0 * 1024.0)
+		, _lastStats.bytesFreed / (1024.0 * 1024.0), _lastStats.deviceMemoryBlocksFreed);
+}
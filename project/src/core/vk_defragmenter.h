@@ -0,0 +1,115 @@
+#pragma once
+#include "big_header.h"
+#include "vk_types.h"
+#include "vk_resources.h"
+#include "vk_barriers.h"
+
+// Incremental defragmentation of a set of VMA pools, one bounded pass per frame and one pool after the other.
+//  Only registry resources that can be copied are moved: sampled images in SHADER_READ_ONLY_OPTIMAL with
+//  transfer src/dst usage, and device local buffers with transfer src/dst usage and no device address
+//  (a buffer's address changes when it moves). Everything else is skipped.
+//  A pass copies its moves on the frame's command buffer and swaps the registry over to the copies right away,
+//  so later commands use the new resources. Frames recorded before the move still use the old ones.
+//  Descriptors holding an image view across frames (the bindless heap) must keep the old view until the pass's frame
+//  has retired, they are rewritten from get_copied_images(). The old resources are destroyed and their memory released
+//  once the frame the descriptors were rewritten in has retired as well.
+class GpuDefragmenter {
+public:
+	static constexpr VkDeviceSize MAX_BYTES_PER_PASS = 16 * 1024 * 1024;
+	static constexpr uint32_t MAX_MOVES_PER_PASS = 64;
+	// automatic defragmentation starts once this share of the allocated blocks is unused
+	static constexpr float FRAGMENTATION_THRESHOLD = 0.3f;
+	// and at least this many bytes would be gained, small heaps are never worth it
+	static constexpr VkDeviceSize MIN_RECLAIMABLE_BYTES = 64 * 1024 * 1024;
+
+	// VK_NULL_HANDLE in pools stands for VMA's default pools. linear pools can't be defragmented
+	void init(VkDevice device, VmaAllocator allocator, ResourceRegistry* registry, std::vector<VmaPool> pools);
+	// caller has waited for the device to go idle. resources retired during the last pass go into deletionQueue
+	void destroy(ResourceDeletionQueue& deletionQueue);
+
+	// returns false if a defragmentation is already running
+	bool begin();
+	bool is_running() const { return _context != VK_NULL_HANDLE; }
+	// unused bytes in allocated blocks / bytes in allocated blocks
+	float get_fragmentation(VkDeviceSize* reclaimableBytes = nullptr) const;
+	bool should_defragment() const;
+
+	// advances the pending pass once the frames it waits for have retired, or records the next one into cmd.
+	//  frameValue is the frame timeline value cmd's submission signals. nothing is moved if allowMoves is false,
+	//  e.g. while uploads into registry resources may still be in flight.
+	//  deletionQueue is the frame's, resources retired during a pass are pushed into it once the pass ends
+	void update(VkCommandBuffer cmd, uint64_t frameValue, uint64_t retiredFrameValue, bool allowMoves, ResourceDeletionQueue& deletionQueue);
+
+	// allocations can't be freed while they are part of a pass, so registered resources are retired through here
+	//  while a defragmentation runs. resources in the pending pass's moves stay registered until it ends, the rest
+	//  go to deletionQueue right away
+	void retire_image(ImageHandle handle, ResourceDeletionQueue& deletionQueue);
+	void retire_buffer(BufferHandle handle, ResourceDeletionQueue& deletionQueue);
+
+	// resources moved by the pass recorded in the last update(), the registry already points at the copies
+	std::span<const ImageHandle> get_moved_images() const { return entered(PassState::Recorded) ? _passImages : std::span<const ImageHandle>(); }
+	std::span<const BufferHandle> get_moved_buffers() const { return entered(PassState::Recorded) ? _passBuffers : std::span<const BufferHandle>(); }
+	// images whose copies completed before the last update(), with every frame recorded before the move retired.
+	//  long lived descriptors can point at the new views now, the old views stay valid until the update()'s frame retires
+	std::span<const ImageHandle> get_copied_images() const { return entered(PassState::Copied) ? _passImages : std::span<const ImageHandle>(); }
+	// the last update() destroyed the old views of a pass, their handles may be reused
+	bool destroyed_image_views() const { return _viewsDestroyed; }
+	// totals of the last completed defragmentation, over all pools
+	const VmaDefragmentationStats& get_last_stats() const { return _lastStats; }
+	uint32_t get_completed_count() const { return _completedCount; }
+
+private:
+	enum class PassState {
+		None,
+		// copies recorded, waiting for their frame to retire
+		Recorded,
+		// copies complete, the old resources are kept until the frame descriptors were rewritten in retires
+		Copied,
+	};
+	bool entered(PassState state) const { return _passChanged && _passState == state; }
+
+	bool record_image_move(VmaDefragmentationMove& move, ImageHandle handle);
+	bool record_buffer_move(VmaDefragmentationMove& move, BufferHandle handle);
+	// destroys the resources replaced by the pending pass, hands its moves back to VMA and retires the resources
+	//  that were retired during it. returns false if that was the last pass
+	bool end_pass(ResourceDeletionQueue& deletionQueue);
+	// the allocation is one of the pending pass's moves, copied or ignored
+	bool in_pass(VmaAllocation allocation) const;
+	void start_pool();
+	// ends the current pool's defragmentation and moves on to the next pool
+	void finish();
+
+	VkDevice _device{ VK_NULL_HANDLE };
+	VmaAllocator _allocator{ VK_NULL_HANDLE };
+	ResourceRegistry* _registry{ nullptr };
+
+	std::vector<VmaPool> _pools;
+	size_t _poolIndex{ 0 };
+	VmaDefragmentationStats _runStats{};
+
+	VmaDefragmentationContext _context{ VK_NULL_HANDLE };
+	VmaDefragmentationPassMoveInfo _passInfo{};
+	PassState _passState{ PassState::None };
+	// the last update() moved the pass to _passState
+	bool _passChanged{ false };
+	bool _viewsDestroyed{ false };
+	// frame timeline value the pending pass waits for, 0 if no pass is pending
+	uint64_t _passFrameValue{ 0 };
+
+	// replaced by the pending pass, destroyed in end_pass()
+	std::vector<VkImage> _oldImages;
+	std::vector<VkImageView> _oldImageViews;
+	std::vector<VkBuffer> _oldBuffers;
+
+	// moved by the pending pass, in the order of _oldImages/_oldBuffers
+	std::vector<ImageHandle> _passImages;
+	std::vector<BufferHandle> _passBuffers;
+	// retired while in the pending pass's moves, retired for real in end_pass()
+	std::vector<ImageHandle> _retiredImages;
+	std::vector<BufferHandle> _retiredBuffers;
+	vkutil::BarrierBuilder _preCopyBarriers;
+	vkutil::BarrierBuilder _postCopyBarriers;
+
+	VmaDefragmentationStats _lastStats{};
+	uint32_t _completedCount{ 0 };
+};
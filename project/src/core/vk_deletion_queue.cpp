@@ -0,0 +1,45 @@
+#include "vk_deletion_queue.h"
+
+namespace {
+	struct Destroyer {
+		VkDevice device;
+		VmaAllocator allocator;
+
+		void operator()(VkImageView view) { vkDestroyImageView(device, view, nullptr); }
+		void operator()(VkImage image, VmaAllocation allocation) {
+			if (allocation != VK_NULL_HANDLE) { vmaDestroyImage(allocator, image, allocation); }
+			else { vkDestroyImage(device, image, nullptr); }
+		}
+		void operator()(VkBuffer buffer, VmaAllocation allocation) { vmaDestroyBuffer(allocator, buffer, allocation); }
+		void operator()(VmaAllocation allocation) { vmaFreeMemory(allocator, allocation); }
+		void operator()(VkSampler sampler) { vkDestroySampler(device, sampler, nullptr); }
+		void operator()(VkShaderEXT shader) { vkDestroyShaderEXT(device, shader, nullptr); }
+		void operator()(VkPipelineLayout layout) { vkDestroyPipelineLayout(device, layout, nullptr); }
+		void operator()(VkDescriptorSetLayout layout) { vkDestroyDescriptorSetLayout(device, layout, nullptr); }
+		void operator()(VkSwapchainKHR swapchain) { vkDestroySwapchainKHR(device, swapchain, nullptr); }
+	};
+}
+
+void ResourceDeletionQueue::flush(VkDevice device, VmaAllocator allocator)
+{
+	drain(Destroyer{ device, allocator });
+}
+
+void ResourceDeletionQueue::clear()
+{
+	_imageViews.clear();
+	_images.clear();
+	_buffers.clear();
+	_allocations.clear();
+	_samplers.clear();
+	_shaders.clear();
+	_pipelineLayouts.clear();
+	_descriptorSetLayouts.clear();
+	_swapchains.clear();
+}
+
+size_t ResourceDeletionQueue::size() const
+{
+	return _imageViews.size() + _images.size() + _buffers.size() + _allocations.size() + _samplers.size()
+		+ _shaders.size() + _pipelineLayouts.size() + _descriptorSetLayouts.size() + _swapchains.size();
+}
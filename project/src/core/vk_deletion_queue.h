@@ -0,0 +1,67 @@
+#pragma once
+#include "big_header.h"
+#include "vk_types.h"
+
+// Deferred destruction of Vulkan objects without per-push allocations.
+//  Handles are stored by type in flat vectors that keep their capacity across flushes, so a steady
+//  state frame never allocates. Used for objects retired by a frame slot, destroyed once it retires.
+class ResourceDeletionQueue {
+public:
+	void push(const AllocatedImage& image) {
+		if (image.imageView != VK_NULL_HANDLE) { _imageViews.push_back(image.imageView); }
+		_images.push_back({ image.image, image.allocation });
+	}
+	void push(const AllocatedBuffer& buffer) { _buffers.push_back({ buffer.buffer, buffer.allocation }); }
+	// image not owned by a VMA allocation of its own (swapchain images excluded, they belong to the swapchain)
+	void push(VkImage image) { _images.push_back({ image, VK_NULL_HANDLE }); }
+	void push(VkImageView imageView) { _imageViews.push_back(imageView); }
+	void push(VkSampler sampler) { _samplers.push_back(sampler); }
+	void push(VmaAllocation allocation) { _allocations.push_back(allocation); }
+	void push(VkShaderEXT shader) { _shaders.push_back(shader); }
+	void push(VkPipelineLayout layout) { _pipelineLayouts.push_back(layout); }
+	void push(VkDescriptorSetLayout layout) { _descriptorSetLayouts.push_back(layout); }
+	void push(VkSwapchainKHR swapchain) { _swapchains.push_back(swapchain); }
+
+	// dependents first: views before their images, images before the memory they are bound to
+	void flush(VkDevice device, VmaAllocator allocator);
+
+	// visits every record in flush order and clears the queue, flush() is drain() with the vkDestroy* calls
+	template<typename Visitor>
+	void drain(Visitor&& visitor) {
+		for (VkImageView view : _imageViews) { visitor(view); }
+		for (const ImageRecord& image : _images) { visitor(image.image, image.allocation); }
+		for (const BufferRecord& buffer : _buffers) { visitor(buffer.buffer, buffer.allocation); }
+		for (VmaAllocation allocation : _allocations) { visitor(allocation); }
+		for (VkSampler sampler : _samplers) { visitor(sampler); }
+		for (VkShaderEXT shader : _shaders) { visitor(shader); }
+		for (VkPipelineLayout layout : _pipelineLayouts) { visitor(layout); }
+		for (VkDescriptorSetLayout layout : _descriptorSetLayouts) { visitor(layout); }
+		for (VkSwapchainKHR swapchain : _swapchains) { visitor(swapchain); }
+		clear();
+	}
+
+	void clear();
+	size_t size() const;
+	// flushing destroys handles descriptor caches may be keyed on
+	bool has_views_or_samplers() const { return !_imageViews.empty() || !_samplers.empty(); }
+
+private:
+	struct ImageRecord {
+		VkImage image;
+		VmaAllocation allocation;
+	};
+	struct BufferRecord {
+		VkBuffer buffer;
+		VmaAllocation allocation;
+	};
+
+	std::vector<VkImageView> _imageViews;
+	std::vector<ImageRecord> _images;
+	std::vector<BufferRecord> _buffers;
+	std::vector<VmaAllocation> _allocations;
+	std::vector<VkSampler> _samplers;
+	std::vector<VkShaderEXT> _shaders;
+	std::vector<VkPipelineLayout> _pipelineLayouts;
+	std::vector<VkDescriptorSetLayout> _descriptorSetLayouts;
+	std::vector<VkSwapchainKHR> _swapchains;
+};
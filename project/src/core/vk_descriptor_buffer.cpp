@@ -1,4 +1,5 @@
 #include "vk_descriptor_buffer.h"
+#include "vk_descriptors.h"
 
 
 VkPhysicalDeviceDescriptorBufferPropertiesEXT DescriptorBuffer::descriptor_buffer_properties = {};
@@ -27,8 +28,7 @@ DescriptorBuffer::DescriptorBuffer(VkInstance instance, VkDevice device
 	// Buffer Offset
 	vkGetDescriptorSetLayoutBindingOffsetEXT(device, descriptorSetLayout, 0u, &descriptor_buffer_offset);
 
-	free_indices = std::vector<int>();
-	for (int i = 0; i < maxObjectCount; i++) { free_indices.push_back(i); }
+	slots.init(maxObjectCount);
 
 	this->max_object_count = maxObjectCount;
 }
@@ -36,11 +36,132 @@ DescriptorBuffer::DescriptorBuffer(VkInstance instance, VkDevice device
 
 void DescriptorBuffer::destroy(VkDevice device, VmaAllocator allocator) {
 	if (is_buffer_mapped) { vmaDestroyBuffer(allocator, descriptor_buffer.buffer, descriptor_buffer.allocation); }
+	for (AllocatedBuffer& previous : previous_buffers) { vmaDestroyBuffer(allocator, previous.buffer, previous.allocation); }
+	previous_buffers.clear();
+}
+
+VersionedDescriptorSet DescriptorBuffer::allocate_versioned_set(VkDevice device)
+{
+	VersionedDescriptorSet set;
+	for (int& index : set.indices) { index = allocate_index(device); }
+	return set;
+}
+
+void DescriptorBuffer::free_versioned_set(const VersionedDescriptorSet& set)
+{
+	for (int index : set.indices) { free_descriptor_buffer(index); }
+}
+
+void DescriptorBuffer::retire_previous_buffers(ResourceDeletionQueue& deletionQueue)
+{
+	for (AllocatedBuffer& previous : previous_buffers) { deletionQueue.push(previous); }
+	previous_buffers.clear();
+}
+
+void DescriptorBuffer::create_buffer(VkDevice device, MemoryPools& memoryPools, VkBufferUsageFlags usage)
+{
+	memory_pools = &memoryPools;
+	buffer_usage = usage;
+
+	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.pNext = nullptr;
+	bufferInfo.size = descriptor_buffer_size * max_object_count;
+	bufferInfo.usage = usage;
+	VmaAllocationCreateInfo vmaAllocInfo = {};
+	vmaAllocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	vmaAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	VK_CHECK(memoryPools.create_buffer(MemoryClass::Descriptors, bufferInfo, vmaAllocInfo, descriptor_buffer));
+
+	descriptor_buffer_gpu_address = get_device_address(device, descriptor_buffer.buffer);
+	buffer_ptr = descriptor_buffer.info.pMappedData;
+	is_buffer_mapped = true;
+}
+
+void DescriptorBuffer::grow(VkDevice device, int capacity)
+{
+	AllocatedBuffer previous = descriptor_buffer;
+	VkDeviceSize writtenSize = descriptor_buffer_size * max_object_count;
+
+	max_object_count = capacity;
+	create_buffer(device, *memory_pools, buffer_usage);
+	// host visible on both sides, a plain copy is enough. reading back write-combined memory is slow, but growing is rare
+	memcpy(buffer_ptr, previous.info.pMappedData, writtenSize);
+	previous_buffers.push_back(previous);
+
+	slots.grow(capacity);
+	fmt::print("DescriptorBuffer: grew to {} sets ({} bytes)\n", capacity, descriptor_buffer_size * capacity);
 }
 
 void DescriptorBuffer::free_descriptor_buffer(int index)
 {
-	free_indices.push_back(index);
+	if (!slots.free(index)) {
+		fmt::print("DescriptorBuffer: freeing index {} that isn't in use\n", index);
+		abort();
+	}
+}
+
+int DescriptorBuffer::allocate_index(VkDevice device)
+{
+	if (slots.free_count() == 0) { grow(device, std::max(max_object_count * 2, 1)); }
+	return slots.allocate();
+}
+
+void DescriptorBuffer::claim_index(int index)
+{
+	if (index < 0 || index >= slots.capacity()) {
+		fmt::print("DescriptorBuffer: index {} out of range ({} slots)\n", index, max_object_count);
+		abort();
+	}
+	slots.claim(index);
+}
+
+void DescriptorSlotAllocator::init(int capacity)
+{
+	free_slots.clear();
+	free_positions.clear();
+	grow(capacity);
+}
+
+void DescriptorSlotAllocator::grow(int capacity)
+{
+	int previousCapacity = this->capacity();
+	if (capacity <= previousCapacity) { return; }
+	free_positions.resize(capacity);
+	// top of the stack is the lowest new slot
+	for (int index = capacity - 1; index >= previousCapacity; index--) {
+		free_positions[index] = static_cast<int>(free_slots.size());
+		free_slots.push_back(index);
+	}
+}
+
+int DescriptorSlotAllocator::allocate()
+{
+	if (free_slots.empty()) { return -1; }
+	int index = free_slots.back();
+	free_slots.pop_back();
+	free_positions[index] = ALLOCATED;
+	return index;
+}
+
+bool DescriptorSlotAllocator::claim(int index)
+{
+	if (index < 0 || index >= capacity() || free_positions[index] == ALLOCATED) { return false; }
+	// the last free slot takes the claimed one's place
+	int position = free_positions[index];
+	int last = free_slots.back();
+	free_slots[position] = last;
+	free_positions[last] = position;
+	free_slots.pop_back();
+	free_positions[index] = ALLOCATED;
+	return true;
+}
+
+bool DescriptorSlotAllocator::free(int index)
+{
+	if (index < 0 || index >= capacity() || free_positions[index] != ALLOCATED) { return false; }
+	free_positions[index] = static_cast<int>(free_slots.size());
+	free_slots.push_back(index);
+	return true;
 }
 
 VkDeviceSize DescriptorBuffer::aligned_size(VkDeviceSize value, VkDeviceSize alignment) {
@@ -59,40 +180,19 @@ inline VkDeviceAddress DescriptorBuffer::get_device_address(VkDevice device, VkB
 
 
 DescriptorBufferSampler::DescriptorBufferSampler(VkInstance instance, VkDevice device
-	, VkPhysicalDevice physicalDevice, VmaAllocator allocator, VkDescriptorSetLayout descriptorSetLayout, int maxObjectCount)
+	, VkPhysicalDevice physicalDevice, VmaAllocator allocator, MemoryPools& memoryPools, VkDescriptorSetLayout descriptorSetLayout, int maxObjectCount)
 	: DescriptorBuffer(instance, device, physicalDevice, allocator, descriptorSetLayout, maxObjectCount)
 {
-	// Allocate Buffer
-	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-	bufferInfo.pNext = nullptr;
-	bufferInfo.size = descriptor_buffer_size * maxObjectCount;
-	bufferInfo.usage =
+	create_buffer(device, memoryPools,
 		VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT
 		| VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
-		| VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT;
-	VmaAllocationCreateInfo vmaAllocInfo = {};
-	vmaAllocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
-	vmaAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
-
-	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo
-		, &descriptor_buffer.buffer
-		, &descriptor_buffer.allocation
-		, &descriptor_buffer.info));
-
-	descriptor_buffer_gpu_address = get_device_address(device, descriptor_buffer.buffer);
-	buffer_ptr = descriptor_buffer.info.pMappedData;
-	is_buffer_mapped = true;
+		| VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT);
 }
 
-int DescriptorBufferSampler::setup_data(VkDevice device, std::vector<DescriptorImageData> data) {
-	if (free_indices.empty()) {
-		fmt::print("Ran out of space in DescriptorBufferUniform\n");
-		abort();
-		return -1;
-	}
-
-	int index = free_indices[0];
-	free_indices.erase(free_indices.begin());
+int DescriptorBufferSampler::setup_data(VkDevice device, std::span<const DescriptorImageData> data) {
+	int index = allocate_index(device);
+	// set_data can't assume anything about what's in the set now
+	if (static_cast<size_t>(index) < written_keys.size()) { written_keys[index].clear(); }
 
 	uint64_t accum_offset{ descriptor_buffer_offset };
 
@@ -163,62 +263,100 @@ int DescriptorBufferSampler::setup_data(VkDevice device, std::vector<DescriptorI
 
 }
 
-void DescriptorBufferSampler::set_data(VkDevice device, std::vector<DescriptorImageData> data, int index) {
-	for (int i = 0; i < free_indices.size(); i++) {
-		if (free_indices[i] == index) {
-			free_indices.erase(free_indices.begin() + i);
-			break;
-		}
+void DescriptorBufferSampler::set_data(VkDevice device, std::span<const DescriptorImageData> data, int index) {
+	claim_index(index);
+	if (written_keys.size() < static_cast<size_t>(max_object_count)) { written_keys.resize(max_object_count); }
+
+	key_scratch.clear();
+	for (const DescriptorImageData& d : data) {
+		for (size_t j = 0; j < d.count; j++) { key_scratch.push_back(make_key(d.type, d.image_info[j])); }
 	}
+	if (key_scratch == written_keys[index]) { return; }
 
+	char* set_ptr = (char*)buffer_ptr + index * descriptor_buffer_size;
 	uint64_t accum_offset{ descriptor_buffer_offset };
 
-	for (int i = 0; i < data.size(); i++) {
-		// image_descriptor_info
-		VkDescriptorGetInfoEXT image_descriptor_info{ VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
-		image_descriptor_info.type = data[i].type;
-		size_t descriptor_size{};
-
-
-		switch (data[i].type) {
-		case VK_DESCRIPTOR_TYPE_SAMPLER:
-			VkSampler samplers[32]; //32 matches upper limit of samplerCount
-			DescriptorImageData d = data[i];
-			if (d.count > 32) { fmt::print("Sampler count exceeds 32\n"); return; }
-			for (int j = 0; j < d.count; j++) { samplers[j] = d.image_info[j].sampler; }
-			image_descriptor_info.data.pSampler = samplers;
-			descriptor_size = descriptor_buffer_properties.samplerDescriptorSize * d.count;
-			break;
-		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
-			image_descriptor_info.data.pCombinedImageSampler = data[i].image_info;
-			descriptor_size = descriptor_buffer_properties.combinedImageSamplerDescriptorSize * data[i].count;
-			break;
-		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
-			image_descriptor_info.data.pSampledImage = data[i].image_info;
-			descriptor_size = descriptor_buffer_properties.sampledImageDescriptorSize * data[i].count;
-			break;
-		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
-			image_descriptor_info.data.pStorageImage = data[i].image_info;
-			descriptor_size = descriptor_buffer_properties.storageImageDescriptorSize * data[i].count;
-			break;
-		default:
-			fmt::print("DescriptorBufferImage::setup_data() called with a non-image/sampler descriptor type\n");
+	size_t k = 0;
+	for (const DescriptorImageData& d : data) {
+		size_t descriptor_size = get_descriptor_size(d.type);
+		if (descriptor_size == 0) {
+			fmt::print("DescriptorBufferImage::set_data() called with a non-image/sampler descriptor type\n");
+			// part of the set may have been overwritten already
+			written_keys[index].clear();
 			return;
 		}
 
-		// pointer to start point
-		char* buffer_ptr_offset = (char*)buffer_ptr + accum_offset + index * descriptor_buffer_size;
-		vkGetDescriptorEXT(
-			device,
-			&image_descriptor_info,
-			descriptor_size,
-			buffer_ptr_offset
-		);
+		for (size_t j = 0; j < d.count; j++, k++) {
+			const DescriptorKey& key = key_scratch[k];
+			auto it = cached_offsets.find(key);
+			if (it == cached_offsets.end()) {
+				if (cached_offsets.size() >= MAX_CACHED_DESCRIPTORS) { invalidate_cache(); }
 
-		accum_offset += descriptor_size;
+				VkDescriptorGetInfoEXT image_descriptor_info{ VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+				image_descriptor_info.type = d.type;
+				switch (d.type) {
+				case VK_DESCRIPTOR_TYPE_SAMPLER:
+					image_descriptor_info.data.pSampler = &d.image_info[j].sampler; break;
+				case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+					image_descriptor_info.data.pCombinedImageSampler = &d.image_info[j]; break;
+				case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+					image_descriptor_info.data.pSampledImage = &d.image_info[j]; break;
+				default:
+					image_descriptor_info.data.pStorageImage = &d.image_info[j]; break;
+				}
+
+				// written to the cache first, the descriptor buffer is write-combined memory that shouldn't be read back
+				it = cached_offsets.emplace(key, cached_bytes.size()).first;
+				cached_bytes.resize(cached_bytes.size() + descriptor_size);
+				vkGetDescriptorEXT(device, &image_descriptor_info, descriptor_size, cached_bytes.data() + it->second);
+			}
+
+			memcpy(set_ptr + accum_offset, cached_bytes.data() + it->second, descriptor_size);
+			accum_offset += descriptor_size;
+		}
+	}
+
+	written_keys[index].assign(key_scratch.begin(), key_scratch.end());
+}
+
+void DescriptorBufferSampler::invalidate_cache()
+{
+	cached_offsets.clear();
+	cached_bytes.clear();
+	for (std::vector<DescriptorKey>& keys : written_keys) { keys.clear(); }
+}
+
+DescriptorKey DescriptorBufferSampler::make_key(VkDescriptorType type, const VkDescriptorImageInfo& imageInfo)
+{
+	DescriptorKey key{ type, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED };
+	if (type == VK_DESCRIPTOR_TYPE_SAMPLER || type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) { key.sampler = imageInfo.sampler; }
+	if (type != VK_DESCRIPTOR_TYPE_SAMPLER) {
+		key.image_view = imageInfo.imageView;
+		key.image_layout = imageInfo.imageLayout;
+	}
+	return key;
+}
+
+size_t DescriptorBufferSampler::get_descriptor_size(VkDescriptorType type) const
+{
+	switch (type) {
+	case VK_DESCRIPTOR_TYPE_SAMPLER: return descriptor_buffer_properties.samplerDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: return descriptor_buffer_properties.combinedImageSamplerDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: return descriptor_buffer_properties.sampledImageDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: return descriptor_buffer_properties.storageImageDescriptorSize;
+	default: return 0;
 	}
 }
 
+size_t DescriptorKeyHash::operator()(const DescriptorKey& key) const
+{
+	std::hash<uint64_t> hasher;
+	size_t hash = hasher((uint64_t)key.image_view);
+	hash ^= hasher((uint64_t)key.sampler) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+	hash ^= hasher((static_cast<uint64_t>(key.type) << 32) | static_cast<uint32_t>(key.image_layout)) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+	return hash;
+}
+
 VkDescriptorBufferBindingInfoEXT DescriptorBufferSampler::get_descriptor_buffer_binding_info() {
 	VkDescriptorBufferBindingInfoEXT descriptor_buffer_binding_info{};
 	descriptor_buffer_binding_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
@@ -232,38 +370,16 @@ VkDescriptorBufferBindingInfoEXT DescriptorBufferSampler::get_descriptor_buffer_
 
 
 DescriptorBufferUniform::DescriptorBufferUniform(VkInstance instance, VkDevice device
-	, VkPhysicalDevice physicalDevice, VmaAllocator allocator, VkDescriptorSetLayout descriptorSetLayout, int maxObjectCount)
+	, VkPhysicalDevice physicalDevice, VmaAllocator allocator, MemoryPools& memoryPools, VkDescriptorSetLayout descriptorSetLayout, int maxObjectCount)
 	: DescriptorBuffer(instance, device, physicalDevice, allocator, descriptorSetLayout, maxObjectCount)
 {
-	// Allocate Buffer
-	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-	bufferInfo.pNext = nullptr;
-	bufferInfo.size = descriptor_buffer_size * maxObjectCount;
-	bufferInfo.usage =
+	create_buffer(device, memoryPools,
 		VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT
-		| VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-	VmaAllocationCreateInfo vmaAllocInfo = {};
-	vmaAllocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
-	vmaAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
-	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo
-		, &descriptor_buffer.buffer
-		, &descriptor_buffer.allocation
-		, &descriptor_buffer.info));
-
-	descriptor_buffer_gpu_address = get_device_address(device, descriptor_buffer.buffer);
-	buffer_ptr = descriptor_buffer.info.pMappedData;
-	is_buffer_mapped = true;
+		| VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
 }
 
 int DescriptorBufferUniform::setup_data(VkDevice device, const AllocatedBuffer& uniform_buffer, size_t allocSize) {
-	if (free_indices.empty()) {
-		fmt::print("Ran out of space in DescriptorBufferUniform\n");
-		abort();
-		return -1;
-	}
-
-	int index = free_indices[0];
-	free_indices.erase(free_indices.begin());
+	int index = allocate_index(device);
 
 
 
@@ -308,3 +424,131 @@ VkDescriptorBufferBindingInfoEXT DescriptorBufferUniform::get_descriptor_buffer_
 	return descriptor_buffer_binding_info;
 }
 
+
+
+DescriptorBufferBindless::DescriptorBufferBindless(VkInstance instance, VkDevice device
+	, VkPhysicalDevice physicalDevice, VmaAllocator allocator, MemoryPools& memoryPools, VkDescriptorSetLayout descriptorSetLayout
+	, uint32_t maxSampledImages, uint32_t maxSamplers, uint32_t maxStorageImages)
+	: DescriptorBufferSampler(instance, device, physicalDevice, allocator, memoryPools, descriptorSetLayout, 1)
+{
+	// the whole buffer is the one set, nothing is handed out through slots
+	claim_index(0);
+
+	init_array(device, samplers, SAMPLER_BINDING, VK_DESCRIPTOR_TYPE_SAMPLER
+		, descriptor_buffer_properties.samplerDescriptorSize, maxSamplers);
+	init_array(device, storage_images, STORAGE_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+		, descriptor_buffer_properties.storageImageDescriptorSize, maxStorageImages);
+	init_array(device, sampled_images, SAMPLED_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE
+		, descriptor_buffer_properties.sampledImageDescriptorSize, maxSampledImages);
+}
+
+VkDescriptorSetLayout DescriptorBufferBindless::create_layout(VkDevice device, VkPhysicalDevice physicalDevice, VkShaderStageFlags stages
+	, uint32_t& maxSampledImages, uint32_t& maxSamplers, uint32_t& maxStorageImages)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	maxSampledImages = std::min(maxSampledImages, properties.limits.maxPerStageDescriptorSampledImages);
+	maxSamplers = std::min(maxSamplers, properties.limits.maxPerStageDescriptorSamplers);
+	maxStorageImages = std::min(maxStorageImages, properties.limits.maxPerStageDescriptorStorageImages);
+
+	DescriptorLayoutBuilder layoutBuilder;
+	layoutBuilder.add_binding(SAMPLER_BINDING, VK_DESCRIPTOR_TYPE_SAMPLER, maxSamplers);
+	layoutBuilder.add_binding(STORAGE_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxStorageImages);
+	layoutBuilder.add_binding(SAMPLED_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, maxSampledImages);
+
+	// unregistered slots are never written, only the last binding may have a variable count
+	VkDescriptorBindingFlags bindingFlags[3] = {
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+		, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+		, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT
+	};
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+	bindingFlagsInfo.bindingCount = 3;
+	bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+	return layoutBuilder.build(device, stages, &bindingFlagsInfo, VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT);
+}
+
+void DescriptorBufferBindless::init_array(VkDevice device, DescriptorArray& array, uint32_t binding, VkDescriptorType type
+	, size_t descriptorSize, uint32_t capacity)
+{
+	array.type = type;
+	vkGetDescriptorSetLayoutBindingOffsetEXT(device, descriptor_set_layout, binding, &array.binding_offset);
+	array.descriptor_size = descriptorSize;
+	array.slots.init(static_cast<int>(capacity));
+}
+
+uint32_t DescriptorBufferBindless::acquire(DescriptorArray& array)
+{
+	int index = array.slots.allocate();
+	if (index < 0) {
+		fmt::print("Ran out of space in DescriptorBufferBindless (descriptor type {}, capacity {})\n", static_cast<int>(array.type), array.slots.capacity());
+		abort();
+	}
+	return static_cast<uint32_t>(index);
+}
+
+void DescriptorBufferBindless::release(DescriptorArray& array, uint32_t index)
+{
+	if (!array.slots.free(static_cast<int>(index))) {
+		fmt::print("DescriptorBufferBindless: releasing index {} that isn't registered\n", index);
+		abort();
+	}
+}
+
+void DescriptorBufferBindless::write(VkDevice device, const DescriptorArray& array, uint32_t index, const VkDescriptorGetInfoEXT& info)
+{
+	char* buffer_ptr_offset = (char*)buffer_ptr + array.binding_offset + index * array.descriptor_size;
+	vkGetDescriptorEXT(device, &info, array.descriptor_size, buffer_ptr_offset);
+}
+
+uint32_t DescriptorBufferBindless::register_sampled_image(VkDevice device, VkImageView imageView, VkImageLayout layout)
+{
+	uint32_t index = acquire(sampled_images);
+	update_sampled_image(device, index, imageView, layout);
+	return index;
+}
+
+void DescriptorBufferBindless::claim_sampled_image(VkDevice device, uint32_t index, VkImageView imageView, VkImageLayout layout)
+{
+	if (!sampled_images.slots.claim(static_cast<int>(index))) {
+		fmt::print("DescriptorBufferBindless: sampled image index {} is already registered or out of range (capacity {})\n", index, sampled_images.slots.capacity());
+		abort();
+	}
+	update_sampled_image(device, index, imageView, layout);
+}
+
+uint32_t DescriptorBufferBindless::register_sampler(VkDevice device, VkSampler sampler)
+{
+	uint32_t index = acquire(samplers);
+	VkDescriptorGetInfoEXT info{ VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+	info.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+	info.data.pSampler = &sampler;
+	write(device, samplers, index, info);
+	return index;
+}
+
+uint32_t DescriptorBufferBindless::register_storage_image(VkDevice device, VkImageView imageView)
+{
+	uint32_t index = acquire(storage_images);
+	update_storage_image(device, index, imageView);
+	return index;
+}
+
+void DescriptorBufferBindless::update_sampled_image(VkDevice device, uint32_t index, VkImageView imageView, VkImageLayout layout)
+{
+	VkDescriptorImageInfo imageInfo{ VK_NULL_HANDLE, imageView, layout };
+	VkDescriptorGetInfoEXT info{ VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+	info.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	info.data.pSampledImage = &imageInfo;
+	write(device, sampled_images, index, info);
+}
+
+void DescriptorBufferBindless::update_storage_image(VkDevice device, uint32_t index, VkImageView imageView)
+{
+	VkDescriptorImageInfo imageInfo{ VK_NULL_HANDLE, imageView, VK_IMAGE_LAYOUT_GENERAL };
+	VkDescriptorGetInfoEXT info{ VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+	info.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	info.data.pStorageImage = &imageInfo;
+	write(device, storage_images, index, info);
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include "vk_types.h"
 #include "big_header.h"
+#include "vk_memory_pools.h"
+#include "vk_deletion_queue.h"
 
 struct DescriptorImageData {
 	VkDescriptorType type;
@@ -8,7 +10,62 @@ struct DescriptorImageData {
 	size_t count;
 };
 
+// what an image/sampler descriptor was written from, fields the type doesn't use are null.
+//  handles can be reused once destroyed, so caches keyed on them have to be invalidated when views or samplers go away
+struct DescriptorKey {
+	VkDescriptorType type;
+	VkImageView image_view;
+	VkSampler sampler;
+	VkImageLayout image_layout;
+
+	bool operator==(const DescriptorKey& other) const = default;
+};
+
+struct DescriptorKeyHash {
+	size_t operator()(const DescriptorKey& key) const;
+};
+
+// Slot bookkeeping for descriptor buffers: a stack of free slots plus each slot's position in it,
+//  so allocating, claiming a specific slot and freeing are all O(1). Right after init/grow the lowest slots are handed
+//  out first, after any free the most recently freed slot is (LIFO).
+class DescriptorSlotAllocator {
+public:
+	static constexpr int ALLOCATED = -1;
+
+	void init(int capacity);
+	// returns -1 if every slot is in use
+	int allocate();
+	// takes a specific slot out of the free list, returns false if it was already allocated
+	bool claim(int index);
+	// returns false for a slot that isn't allocated (double free or out of range)
+	bool free(int index);
+
+	// adds slots up to capacity, they are handed out before the existing free ones
+	void grow(int capacity);
+
+	bool is_allocated(int index) const { return index >= 0 && index < capacity() && free_positions[index] == ALLOCATED; }
+	int capacity() const { return static_cast<int>(free_positions.size()); }
+	int free_count() const { return static_cast<int>(free_slots.size()); }
+
+private:
+	std::vector<int> free_slots;
+	// position of each slot in free_slots, ALLOCATED if it's in use
+	std::vector<int> free_positions;
+};
+
+// A set that is rewritten while earlier frames may still be reading it, one copy per frame in flight.
+//  Only the copy of the current frame slot is written and bound, the GPU is done with it once that slot's last frame retired.
+struct VersionedDescriptorSet {
+	static constexpr int MAX_VERSIONS = 4;
+	std::array<int, MAX_VERSIONS> indices{};
+
+	int get_index(uint32_t frameSlot) const { return indices[frameSlot]; }
+};
 
+// A descriptor buffer with room for a number of sets of one layout.
+//  Running out of sets reallocates the buffer at twice the size. Frames already recorded keep the old buffer bound,
+//  so it's held until retire_previous_buffers() hands it to a frame's deletion queue.
+//  The binding address changes when it grows, bind from get_descriptor_buffer_binding_info() after the last setup_data().
 class DescriptorBuffer {
 public:
 	DescriptorBuffer() = default;
@@ -17,6 +74,17 @@ public:
 
 	void destroy(VkDevice device, VmaAllocator allocator);
 	void free_descriptor_buffer(int index);
+	// buffers replaced by growing, destroyed once the queue's frame retires
+	void retire_previous_buffers(ResourceDeletionQueue& deletionQueue);
+
+	// a set per version, written with set_data() at get_index() of the frame slot
+	VersionedDescriptorSet allocate_versioned_set(VkDevice device);
+	void free_versioned_set(const VersionedDescriptorSet& set);
+	// for vkCmdSetDescriptorBufferOffsetsEXT
+	VkDeviceSize get_set_offset(int index) const { return index * descriptor_buffer_size; }
+
+	VkDeviceAddress get_buffer_address() const { return descriptor_buffer_gpu_address; }
+	int get_capacity() const { return max_object_count; }
 
 	VkDeviceSize descriptor_buffer_size;
 	VkDeviceSize descriptor_buffer_offset;
@@ -33,7 +101,20 @@ protected:
 	// total size of layout is at least sum of all bindings
 	//   but it can be larger due to potential metadata or pading from driver implementationVkDeviceSize descriptor_buffer_offset;
 
-	std::vector<int> free_indices;
+	// allocates and maps a buffer for max_object_count sets in the Descriptors pool
+	void create_buffer(VkDevice device, MemoryPools& memoryPools, VkBufferUsageFlags usage);
+	// grows the buffer when full
+	int allocate_index(VkDevice device);
+	// marks index as in use if it isn't already
+	void claim_index(int index);
+	// copies the written sets into a buffer with room for capacity sets
+	void grow(VkDevice device, int capacity);
+
+	MemoryPools* memory_pools;
+	VkBufferUsageFlags buffer_usage;
+	std::vector<AllocatedBuffer> previous_buffers;
+
+	DescriptorSlotAllocator slots;
 	int max_object_count;
 
 	// static these things cause they are the same for all instances.
@@ -49,7 +130,7 @@ class DescriptorBufferUniform : public DescriptorBuffer {
 public:
 	DescriptorBufferUniform() = default;
 	DescriptorBufferUniform(VkInstance instance, VkDevice device, VkPhysicalDevice physicalDevice
-		, VmaAllocator allocator, VkDescriptorSetLayout descriptorSetLayout, int maxObjectCount = 10);
+		, VmaAllocator allocator, MemoryPools& memoryPools, VkDescriptorSetLayout descriptorSetLayout, int maxObjectCount = 10);
 
 	int setup_data(VkDevice device, const AllocatedBuffer& uniform_buffer, size_t allocSize);
 	VkDescriptorBufferBindingInfoEXT get_descriptor_buffer_binding_info();
@@ -63,13 +144,90 @@ class DescriptorBufferSampler : public DescriptorBuffer {
 public:
 	DescriptorBufferSampler() = default;
 	DescriptorBufferSampler(VkInstance instance, VkDevice device, VkPhysicalDevice physicalDevice
-		, VmaAllocator allocator, VkDescriptorSetLayout descriptorSetLayout, int maxObjectCount = 10);
+		, VmaAllocator allocator, MemoryPools& memoryPools, VkDescriptorSetLayout descriptorSetLayout, int maxObjectCount = 10);
 
-	int setup_data(VkDevice device, std::vector<DescriptorImageData> data);
-	void set_data(VkDevice device, std::vector<DescriptorImageData> data, int index);
+	int setup_data(VkDevice device, std::span<const DescriptorImageData> data);
+	// a set written with the same descriptors as last time is left as is,
+	//  descriptors written before are copied from the cache instead of asking the driver again
+	void set_data(VkDevice device, std::span<const DescriptorImageData> data, int index);
 	VkDescriptorBufferBindingInfoEXT get_descriptor_buffer_binding_info();
-};
 
+	// call when an image view or sampler that may have been written is destroyed
+	void invalidate_cache();
+
+private:
+	static constexpr size_t MAX_CACHED_DESCRIPTORS = 1024;
 
+	static DescriptorKey make_key(VkDescriptorType type, const VkDescriptorImageInfo& imageInfo);
+	size_t get_descriptor_size(VkDescriptorType type) const;
 
+	// keys each set was last written with by set_data
+	std::vector<std::vector<DescriptorKey>> written_keys;
+	std::vector<DescriptorKey> key_scratch;
+	// descriptor bytes by key, offsets into cached_bytes
+	std::unordered_map<DescriptorKey, size_t, DescriptorKeyHash> cached_offsets;
+	std::vector<char> cached_bytes;
+};
 
+// One global heap for GPU-driven rendering: every texture, sampler and storage image lives in a single
+//  partially bound array and shaders index it with an integer, so the heap is bound once per command buffer.
+//  Sampled images are the last binding so their array can be variable-count (the heap's capacity).
+//  Registering and unregistering is O(1) through a free list per array.
+//  Writes go straight into the mapped buffer, an index must not be unregistered while a frame in flight may read it,
+//  and only rewritten while the old and new descriptor are both valid for every such frame.
+class DescriptorBufferBindless : public DescriptorBufferSampler {
+public:
+	static constexpr uint32_t SAMPLER_BINDING = 0;
+	static constexpr uint32_t STORAGE_IMAGE_BINDING = 1;
+	static constexpr uint32_t SAMPLED_IMAGE_BINDING = 2;
+	static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+	DescriptorBufferBindless() = default;
+	DescriptorBufferBindless(VkInstance instance, VkDevice device, VkPhysicalDevice physicalDevice
+		, VmaAllocator allocator, MemoryPools& memoryPools, VkDescriptorSetLayout descriptorSetLayout
+		, uint32_t maxSampledImages, uint32_t maxSamplers, uint32_t maxStorageImages);
+
+	// counts are clamped to the device's per stage limits, the clamped values are written back
+	static VkDescriptorSetLayout create_layout(VkDevice device, VkPhysicalDevice physicalDevice, VkShaderStageFlags stages
+		, uint32_t& maxSampledImages, uint32_t& maxSamplers, uint32_t& maxStorageImages);
+
+	// returns the array index shaders use, aborts if the array is full
+	uint32_t register_sampled_image(VkDevice device, VkImageView imageView, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	uint32_t register_sampler(VkDevice device, VkSampler sampler);
+	uint32_t register_storage_image(VkDevice device, VkImageView imageView);
+	// registers the image at a chosen index, e.g. its resource handle's. aborts if the index is taken or out of range.
+	//  don't mix with register_sampled_image in one heap, it may already have handed the index out
+	void claim_sampled_image(VkDevice device, uint32_t index, VkImageView imageView, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	uint32_t get_sampled_image_capacity() const { return static_cast<uint32_t>(sampled_images.slots.capacity()); }
+
+	// points an existing index at a new view, e.g. after the image was moved
+	void update_sampled_image(VkDevice device, uint32_t index, VkImageView imageView, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	void update_storage_image(VkDevice device, uint32_t index, VkImageView imageView);
+
+	void unregister_sampled_image(uint32_t index) { release(sampled_images, index); }
+	void unregister_sampler(uint32_t index) { release(samplers, index); }
+	void unregister_storage_image(uint32_t index) { release(storage_images, index); }
+
+	uint32_t get_sampled_image_count() const { return sampled_images.live_count(); }
+	uint32_t get_sampler_count() const { return samplers.live_count(); }
+	uint32_t get_storage_image_count() const { return storage_images.live_count(); }
+
+private:
+	struct DescriptorArray {
+		VkDescriptorType type;
+		VkDeviceSize binding_offset;
+		size_t descriptor_size;
+		DescriptorSlotAllocator slots;
+
+		uint32_t live_count() const { return static_cast<uint32_t>(slots.capacity() - slots.free_count()); }
+	};
+
+	void init_array(VkDevice device, DescriptorArray& array, uint32_t binding, VkDescriptorType type, size_t descriptorSize, uint32_t capacity);
+	uint32_t acquire(DescriptorArray& array);
+	void release(DescriptorArray& array, uint32_t index);
+	void write(VkDevice device, const DescriptorArray& array, uint32_t index, const VkDescriptorGetInfoEXT& info);
+
+	DescriptorArray sampled_images{};
+	DescriptorArray samplers{};
+	DescriptorArray storage_images{};
+};
@@ -0,0 +1,53 @@
+#include "vk_frame_allocator.h"
+
+void FrameAllocator::init(VkDevice device, VkPhysicalDevice physicalDevice, VmaAllocator allocator, MemoryPools& memoryPools, VkDeviceSize capacity)
+{
+	_allocator = allocator;
+	_capacity = capacity;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	_minAlignment = std::max({ _minAlignment
+		, properties.limits.minUniformBufferOffsetAlignment
+		, properties.limits.minStorageBufferOffsetAlignment });
+
+	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.pNext = nullptr;
+	bufferInfo.size = capacity;
+	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		| VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+	VmaAllocationCreateInfo vmaallocInfo = {};
+	vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	vmaallocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	VK_CHECK(memoryPools.create_buffer(MemoryClass::Streaming, bufferInfo, vmaallocInfo, _buffer));
+
+	VkBufferDeviceAddressInfo addressInfo{ VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = _buffer.buffer;
+	_address = vkGetBufferDeviceAddress(device, &addressInfo);
+}
+
+void FrameAllocator::destroy()
+{
+	vmaDestroyBuffer(_allocator, _buffer.buffer, _buffer.allocation);
+	_buffer = {};
+	_head = 0;
+}
+
+FrameAllocation FrameAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	alignment = std::max(alignment, _minAlignment);
+	VkDeviceSize offset = (_head + alignment - 1) / alignment * alignment;
+	if (offset + size > _capacity) {
+		fmt::print("Frame Allocator: out of memory ({} of {} bytes used, {} requested)\n", _head, _capacity, size);
+		abort();
+	}
+	_head = offset + size;
+
+	FrameAllocation allocation;
+	allocation.cpu = static_cast<char*>(_buffer.info.pMappedData) + offset;
+	allocation.address = _address + offset;
+	allocation.offset = offset;
+	return allocation;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "big_header.h"
+#include "vk_types.h"
+#include "vk_memory_pools.h"
+
+struct FrameAllocation {
+	void* cpu;
+	VkDeviceAddress address;
+	VkDeviceSize offset;
+};
+
+// Bump allocator over one persistently mapped, device addressable buffer.
+//  Owned by a frame slot and reset once that slot's previous frame has retired, so allocations
+//  live for exactly one frame. Meant for uniforms, instance data and indirect arguments.
+class FrameAllocator {
+public:
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, VmaAllocator allocator, MemoryPools& memoryPools, VkDeviceSize capacity);
+	void destroy();
+
+	// aligned to at least the device's uniform/storage buffer offset alignment
+	FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+	// a single value, containers go through the range overload so their header isn't copied instead of their elements
+	template<typename T>
+		requires (std::is_trivially_copyable_v<T> && !std::ranges::contiguous_range<T>)
+	FrameAllocation push(const T& data) {
+		FrameAllocation allocation = allocate(sizeof(T), alignof(T));
+		memcpy(allocation.cpu, &data, sizeof(T));
+		return allocation;
+	}
+	// the elements of a vector, array, span...
+	template<std::ranges::contiguous_range R>
+		requires std::is_trivially_copyable_v<std::ranges::range_value_t<R>>
+	FrameAllocation push(const R& data) {
+		using T = std::ranges::range_value_t<R>;
+		size_t sizeBytes = std::ranges::size(data) * sizeof(T);
+		FrameAllocation allocation = allocate(sizeBytes, alignof(T));
+		memcpy(allocation.cpu, std::ranges::data(data), sizeBytes);
+		return allocation;
+	}
+
+	void reset() { _head = 0; }
+
+	VkBuffer get_buffer() const { return _buffer.buffer; }
+	VkDeviceSize get_used() const { return _head; }
+	VkDeviceSize get_capacity() const { return _capacity; }
+
+private:
+	VmaAllocator _allocator{ VK_NULL_HANDLE };
+	AllocatedBuffer _buffer{};
+	VkDeviceAddress _address{ 0 };
+	VkDeviceSize _capacity{ 0 };
+	VkDeviceSize _minAlignment{ 16 };
+	VkDeviceSize _head{ 0 };
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include <vk_initializers.h>
+#include <vk_barriers.h>
 
 namespace vkutil {
 	void transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout targetLayout);
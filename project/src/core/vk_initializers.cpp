@@ -7,7 +7,7 @@ VkCommandPoolCreateInfo vkinit::command_pool_create_info(uint32_t queueFamilyInd
     VkCommandPoolCreateInfo info = {};
     info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     info.pNext = nullptr;
-
+    info.queueFamilyIndex = queueFamilyIndex;
     info.flags = flags;
     return info;
 }
@@ -60,10 +60,21 @@ VkSemaphoreCreateInfo vkinit::semaphore_create_info(VkSemaphoreCreateFlags flags
     info.flags = flags;
     return info;
 }
+
+// chain into semaphore_create_info().pNext; binary semaphores ignore the initial value
+VkSemaphoreTypeCreateInfo vkinit::semaphore_type_create_info(VkSemaphoreType type, uint64_t initialValue /*= 0*/)
+{
+    VkSemaphoreTypeCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    info.pNext = nullptr;
+    info.semaphoreType = type;
+    info.initialValue = initialValue;
+    return info;
+}
 //< init_sync
 
 //> init_submit
-VkSemaphoreSubmitInfo vkinit::semaphore_submit_info(VkPipelineStageFlags2 stageMask, VkSemaphore semaphore)
+VkSemaphoreSubmitInfo vkinit::semaphore_submit_info(VkPipelineStageFlags2 stageMask, VkSemaphore semaphore, uint64_t value /*= 1*/)
 {
 	VkSemaphoreSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
@@ -71,7 +82,7 @@ VkSemaphoreSubmitInfo vkinit::semaphore_submit_info(VkPipelineStageFlags2 stageM
 	submitInfo.semaphore = semaphore;
 	submitInfo.stageMask = stageMask;
 	submitInfo.deviceIndex = 0;
-	submitInfo.value = 1;
+	submitInfo.value = value;
 
 	return submitInfo;
 }
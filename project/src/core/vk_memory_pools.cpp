@@ -0,0 +1,198 @@
+#include "vk_memory_pools.h"
+#include "vk_initializers.h"
+
+namespace {
+	struct PoolConfig {
+		const char* name;
+		// 0 lets VMA pick the size and allows dedicated allocations in the pool
+		VkDeviceSize blockSize;
+		VmaPoolCreateFlags flags;
+	};
+
+	constexpr VkDeviceSize MB = 1024 * 1024;
+	constexpr std::array<PoolConfig, MemoryPools::CLASS_COUNT> POOL_CONFIGS{ {
+		{ "Textures", 64 * MB, 0 },
+		{ "Render Targets", 0, 0 },
+		{ "Buffers", 64 * MB, 0 },
+		{ "Upload Buffers", 64 * MB, 0 },
+		{ "Staging", 64 * MB, VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT },
+		{ "Streaming", 128 * MB, VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT },
+		{ "Descriptors", 4 * MB, 0 },
+	} };
+
+	// representative resources of each class, the pool uses the memory type VMA picks for them
+	uint32_t find_buffer_memory_type(VmaAllocator allocator, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VmaAllocationCreateFlags flags)
+	{
+		VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.size = 64 * 1024;
+		bufferInfo.usage = usage;
+		VmaAllocationCreateInfo allocInfo = {};
+		allocInfo.usage = memoryUsage;
+		allocInfo.flags = flags;
+		uint32_t memoryTypeIndex;
+		VK_CHECK(vmaFindMemoryTypeIndexForBufferInfo(allocator, &bufferInfo, &allocInfo, &memoryTypeIndex));
+		return memoryTypeIndex;
+	}
+
+	uint32_t find_image_memory_type(VmaAllocator allocator, VkFormat format, VkImageUsageFlags usage)
+	{
+		VkImageCreateInfo imageInfo = vkinit::image_create_info(format, usage, { 1024, 1024, 1 });
+		VmaAllocationCreateInfo allocInfo = {};
+		allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		uint32_t memoryTypeIndex;
+		VK_CHECK(vmaFindMemoryTypeIndexForImageInfo(allocator, &imageInfo, &allocInfo, &memoryTypeIndex));
+		return memoryTypeIndex;
+	}
+}
+
+VkDeviceSize vkutil::get_direct_upload_heap_size(VmaAllocator allocator)
+{
+	const VkPhysicalDeviceMemoryProperties* memoryProperties;
+	vmaGetMemoryProperties(allocator, &memoryProperties);
+	constexpr VkMemoryPropertyFlags directFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	VkDeviceSize heapSize = 0;
+	for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) {
+		const VkMemoryType& type = memoryProperties->memoryTypes[i];
+		if ((type.propertyFlags & directFlags) != directFlags) { continue; }
+		heapSize = std::max(heapSize, memoryProperties->memoryHeaps[type.heapIndex].size);
+	}
+	return heapSize;
+}
+
+void MemoryPools::init(VkDevice device, VmaAllocator allocator)
+{
+	_device = device;
+	_allocator = allocator;
+
+	// buffers filled by the host are placed where it can write them when direct uploads are possible
+	VmaAllocationCreateFlags uploadBufferFlags = 0;
+	if (vkutil::get_direct_upload_heap_size(allocator) > vkutil::LEGACY_BAR_SIZE) {
+		uploadBufferFlags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT;
+	}
+
+	std::array<uint32_t, CLASS_COUNT> memoryTypes{};
+	memoryTypes[index(MemoryClass::Textures)] = find_image_memory_type(allocator, VK_FORMAT_R8G8B8A8_UNORM
+		, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	memoryTypes[index(MemoryClass::RenderTargets)] = find_image_memory_type(allocator, VK_FORMAT_R16G16B16A16_SFLOAT
+		, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+		| VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	constexpr VkBufferUsageFlags deviceBufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+		| VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+		| VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	// without host access flags VMA avoids host visible types, so the defragmenter can move these
+	memoryTypes[index(MemoryClass::Buffers)] = find_buffer_memory_type(allocator, deviceBufferUsage, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+	memoryTypes[index(MemoryClass::UploadBuffers)] = find_buffer_memory_type(allocator, deviceBufferUsage
+		, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, uploadBufferFlags);
+	memoryTypes[index(MemoryClass::Staging)] = find_buffer_memory_type(allocator
+		, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+	memoryTypes[index(MemoryClass::Streaming)] = find_buffer_memory_type(allocator
+		, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		| VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+		, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+	memoryTypes[index(MemoryClass::Descriptors)] = find_buffer_memory_type(allocator
+		, VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT
+		| VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+		, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+	for (uint32_t i = 0; i < CLASS_COUNT; i++) {
+		VmaPoolCreateInfo poolInfo = {};
+		poolInfo.memoryTypeIndex = memoryTypes[i];
+		poolInfo.blockSize = POOL_CONFIGS[i].blockSize;
+		poolInfo.flags = POOL_CONFIGS[i].flags;
+		VK_CHECK(vmaCreatePool(_allocator, &poolInfo, &_pools[i].pool));
+		// shows up in the JSON statistics
+		vmaSetPoolName(_allocator, _pools[i].pool, POOL_CONFIGS[i].name);
+		_pools[i].memoryTypeIndex = memoryTypes[i];
+		_pools[i].blockSize = POOL_CONFIGS[i].blockSize;
+		_pools[i].fallbackCount = 0;
+	}
+}
+
+void MemoryPools::destroy()
+{
+	for (Pool& pool : _pools) {
+		if (pool.pool != VK_NULL_HANDLE) { vmaDestroyPool(_allocator, pool.pool); }
+		pool = {};
+	}
+}
+
+VkResult MemoryPools::create_buffer(MemoryClass memoryClass, const VkBufferCreateInfo& bufferInfo, const VmaAllocationCreateInfo& allocInfo, AllocatedBuffer& buffer)
+{
+	VkMemoryDedicatedRequirements dedicated{ .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+	VkMemoryRequirements2 requirements{ .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2, .pNext = &dedicated };
+	VkDeviceBufferMemoryRequirements requirementsInfo{ .sType = VK_STRUCTURE_TYPE_DEVICE_BUFFER_MEMORY_REQUIREMENTS };
+	requirementsInfo.pCreateInfo = &bufferInfo;
+	vkGetDeviceBufferMemoryRequirements(_device, &requirementsInfo, &requirements);
+
+	VmaAllocationCreateInfo poolAllocInfo = allocInfo;
+	poolAllocInfo.pool = select_pool(memoryClass, requirements.memoryRequirements, dedicated.requiresDedicatedAllocation);
+	VkResult result = vmaCreateBuffer(_allocator, &bufferInfo, &poolAllocInfo, &buffer.buffer, &buffer.allocation, &buffer.info);
+	if (result != VK_SUCCESS && poolAllocInfo.pool != VK_NULL_HANDLE) {
+		_pools[index(memoryClass)].fallbackCount++;
+		result = vmaCreateBuffer(_allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, &buffer.info);
+	}
+	buffer.usage = bufferInfo.usage;
+	buffer.size = bufferInfo.size;
+	return result;
+}
+
+VkResult MemoryPools::create_image(MemoryClass memoryClass, const VkImageCreateInfo& imageInfo, const VmaAllocationCreateInfo& allocInfo, VkImage* image, VmaAllocation* allocation)
+{
+	VkMemoryDedicatedRequirements dedicated{ .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+	VkMemoryRequirements2 requirements{ .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2, .pNext = &dedicated };
+	VkDeviceImageMemoryRequirements requirementsInfo{ .sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS };
+	requirementsInfo.pCreateInfo = &imageInfo;
+	vkGetDeviceImageMemoryRequirements(_device, &requirementsInfo, &requirements);
+
+	VmaAllocationCreateInfo poolAllocInfo = allocInfo;
+	poolAllocInfo.pool = select_pool(memoryClass, requirements.memoryRequirements, dedicated.requiresDedicatedAllocation);
+	VkResult result = vmaCreateImage(_allocator, &imageInfo, &poolAllocInfo, image, allocation, nullptr);
+	if (result != VK_SUCCESS && poolAllocInfo.pool != VK_NULL_HANDLE) {
+		_pools[index(memoryClass)].fallbackCount++;
+		result = vmaCreateImage(_allocator, &imageInfo, &allocInfo, image, allocation, nullptr);
+	}
+	return result;
+}
+
+VkResult MemoryPools::allocate(MemoryClass memoryClass, const VkMemoryRequirements& requirements, const VmaAllocationCreateInfo& allocInfo, VmaAllocation* allocation)
+{
+	VmaAllocationCreateInfo poolAllocInfo = allocInfo;
+	poolAllocInfo.pool = select_pool(memoryClass, requirements, false);
+	VkResult result = vmaAllocateMemory(_allocator, &requirements, &poolAllocInfo, allocation, nullptr);
+	if (result != VK_SUCCESS && poolAllocInfo.pool != VK_NULL_HANDLE) {
+		_pools[index(memoryClass)].fallbackCount++;
+		result = vmaAllocateMemory(_allocator, &requirements, &allocInfo, allocation, nullptr);
+	}
+	return result;
+}
+
+VmaPool MemoryPools::select_pool(MemoryClass memoryClass, const VkMemoryRequirements& requirements, bool dedicated)
+{
+	Pool& pool = _pools[index(memoryClass)];
+	bool fits = (requirements.memoryTypeBits & (1u << pool.memoryTypeIndex)) != 0;
+	// pools with an explicit block size can't make dedicated allocations or ones larger than a block
+	if (pool.blockSize != 0 && (dedicated || requirements.size > pool.blockSize)) { fits = false; }
+	if (!fits) {
+		pool.fallbackCount++;
+		return VK_NULL_HANDLE;
+	}
+	return pool.pool;
+}
+
+const char* MemoryPools::get_name(MemoryClass memoryClass) const
+{
+	return POOL_CONFIGS[index(memoryClass)].name;
+}
+
+bool MemoryPools::is_linear(MemoryClass memoryClass) const
+{
+	return (POOL_CONFIGS[index(memoryClass)].flags & VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT) != 0;
+}
+
+VmaDetailedStatistics MemoryPools::get_statistics(MemoryClass memoryClass) const
+{
+	VmaDetailedStatistics stats{};
+	vmaCalculatePoolStatistics(_allocator, get_pool(memoryClass), &stats);
+	return stats;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "big_header.h"
+#include "vk_types.h"
+
+// Resource classes with their own VMA pool, so allocations with different lifetimes don't share blocks
+enum class MemoryClass : uint32_t {
+	Textures,      // sampled images, long lived
+	RenderTargets, // draw images, rebuilt on resize
+	Buffers,       // device local buffers only the GPU writes, kept out of host visible VRAM so they can be defragmented
+	UploadBuffers, // device local buffers filled by the host, in host visible VRAM when direct uploads are possible
+	Staging,       // upload staging buffers freed within a few frames, linear
+	Streaming,     // persistently mapped rings and per-frame buffers allocated once, linear
+	Descriptors,   // descriptor buffers
+	Count
+};
+
+namespace vkutil {
+	// host visible device local heaps up to this size are the BAR window of discrete GPUs without resizable BAR
+	constexpr VkDeviceSize LEGACY_BAR_SIZE = 256 * 1024 * 1024;
+	// largest heap with memory that is both device local and host visible, 0 if there is none
+	VkDeviceSize get_direct_upload_heap_size(VmaAllocator allocator);
+}
+
+// One custom VMA pool per MemoryClass.
+//  Each pool is pinned to the memory type its class's resources use. A resource whose memory type isn't that one,
+//  that is larger than a block, or that needs a dedicated allocation goes to VMA's default pools instead. That is
+//  counted as a fallback for the class.
+class MemoryPools {
+public:
+	static constexpr uint32_t CLASS_COUNT = static_cast<uint32_t>(MemoryClass::Count);
+
+	void init(VkDevice device, VmaAllocator allocator);
+	// every allocation from the pools has to be freed first
+	void destroy();
+
+	VkResult create_buffer(MemoryClass memoryClass, const VkBufferCreateInfo& bufferInfo, const VmaAllocationCreateInfo& allocInfo, AllocatedBuffer& buffer);
+	VkResult create_image(MemoryClass memoryClass, const VkImageCreateInfo& imageInfo, const VmaAllocationCreateInfo& allocInfo, VkImage* image, VmaAllocation* allocation);
+	// memory for resources bound later, e.g. aliased images
+	VkResult allocate(MemoryClass memoryClass, const VkMemoryRequirements& requirements, const VmaAllocationCreateInfo& allocInfo, VmaAllocation* allocation);
+
+	VmaPool get_pool(MemoryClass memoryClass) const { return _pools[index(memoryClass)].pool; }
+	const char* get_name(MemoryClass memoryClass) const;
+	bool is_linear(MemoryClass memoryClass) const;
+	// allocations of the class that went to the default pools
+	uint32_t get_fallback_count(MemoryClass memoryClass) const { return _pools[index(memoryClass)].fallbackCount; }
+	VmaDetailedStatistics get_statistics(MemoryClass memoryClass) const;
+
+private:
+	struct Pool {
+		VmaPool pool;
+		uint32_t memoryTypeIndex;
+		VkDeviceSize blockSize;
+		uint32_t fallbackCount;
+	};
+
+	static uint32_t index(MemoryClass memoryClass) { return static_cast<uint32_t>(memoryClass); }
+	// the class's pool if it can hold the resource, VK_NULL_HANDLE (the default pools) otherwise
+	VmaPool select_pool(MemoryClass memoryClass, const VkMemoryRequirements& requirements, bool dedicated);
+
+	VkDevice _device{ VK_NULL_HANDLE };
+	VmaAllocator _allocator{ VK_NULL_HANDLE };
+	std::array<Pool, CLASS_COUNT> _pools{};
+};
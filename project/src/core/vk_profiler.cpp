@@ -0,0 +1,99 @@
+#include "vk_profiler.h"
+
+// scope index returned when timestamps are unsupported or MAX_SCOPES is exceeded
+constexpr uint32_t INVALID_SCOPE = ~0u;
+
+void GpuProfiler::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t frameCount)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t queueFamilyCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+	_supported = validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+	if (!_supported) {
+		fmt::print("GPU Profiler: queue family {} does not support timestamps\n", queueFamilyIndex);
+		return;
+	}
+	_timestampPeriod = properties.limits.timestampPeriod;
+	_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	VkQueryPoolCreateInfo poolInfo{ .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+	poolInfo.pNext = nullptr;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = MAX_SCOPES * 2;
+
+	_frames.resize(frameCount);
+	for (FrameQueries& frame : _frames) {
+		VK_CHECK(vkCreateQueryPool(device, &poolInfo, nullptr, &frame.pool));
+		frame.scopes.reserve(MAX_SCOPES);
+	}
+	_timestamps.resize(MAX_SCOPES * 2);
+	_results.reserve(MAX_SCOPES);
+}
+
+void GpuProfiler::destroy(VkDevice device)
+{
+	for (FrameQueries& frame : _frames) {
+		vkDestroyQueryPool(device, frame.pool, nullptr);
+	}
+	_frames.clear();
+}
+
+void GpuProfiler::begin_frame(VkDevice device, VkCommandBuffer cmd, uint32_t frameIndex)
+{
+	if (!_supported) { return; }
+	_current = &_frames[frameIndex];
+	_depth = 0;
+
+	if (_current->hasResults && _current->queryCount > 0) {
+		// no WAIT flag, the slot has retired so this only fails if a query was never written
+		VkResult result = vkGetQueryPoolResults(device, _current->pool, 0, _current->queryCount
+			, _current->queryCount * sizeof(uint64_t), _timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+		if (result == VK_SUCCESS) {
+			_results.clear();
+			for (const Scope& scope : _current->scopes) {
+				if (scope.endQuery == INVALID_SCOPE) { continue; }
+				uint64_t begin = _timestamps[scope.beginQuery] & _timestampMask;
+				uint64_t end = _timestamps[scope.endQuery] & _timestampMask;
+				float ms = static_cast<float>(static_cast<double>(end - begin) * _timestampPeriod / 1000000.0);
+				_results.push_back({ scope.name, scope.depth, ms });
+			}
+		}
+	}
+
+	vkCmdResetQueryPool(cmd, _current->pool, 0, MAX_SCOPES * 2);
+	_current->scopes.clear();
+	_current->queryCount = 0;
+	_current->hasResults = true;
+}
+
+uint32_t GpuProfiler::begin_scope(VkCommandBuffer cmd, const char* name)
+{
+	if (!_supported || _current == nullptr || _current->scopes.size() >= MAX_SCOPES) { return INVALID_SCOPE; }
+
+	Scope scope{};
+	scope.name = name;
+	scope.depth = _depth++;
+	scope.beginQuery = _current->queryCount++;
+	scope.endQuery = INVALID_SCOPE;
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _current->pool, scope.beginQuery);
+
+	_current->scopes.push_back(scope);
+	return static_cast<uint32_t>(_current->scopes.size() - 1);
+}
+
+void GpuProfiler::end_scope(VkCommandBuffer cmd, uint32_t scope)
+{
+	if (scope == INVALID_SCOPE) { return; }
+
+	Scope& s = _current->scopes[scope];
+	s.endQuery = _current->queryCount++;
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _current->pool, s.endQuery);
+	_depth--;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "big_header.h"
+
+// Per-frame GPU timestamp profiler.
+//  Every frame slot owns a query pool. begin_frame() is called once that slot's previous
+//  submission has retired, so its results are read back without waiting on the GPU.
+class GpuProfiler {
+public:
+	static constexpr uint32_t MAX_SCOPES = 64;
+
+	struct ScopeResult {
+		const char* name;
+		uint32_t depth;
+		float milliseconds;
+	};
+
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t frameCount);
+	void destroy(VkDevice device);
+
+	// reads the results of the last frame recorded into this slot and resets its queries
+	void begin_frame(VkDevice device, VkCommandBuffer cmd, uint32_t frameIndex);
+	uint32_t begin_scope(VkCommandBuffer cmd, const char* name);
+	void end_scope(VkCommandBuffer cmd, uint32_t scope);
+
+	// scopes of the most recently retired frame, in recording order
+	const std::vector<ScopeResult>& get_results() const { return _results; }
+	bool is_supported() const { return _supported; }
+
+private:
+	struct Scope {
+		const char* name;
+		uint32_t depth;
+		uint32_t beginQuery;
+		uint32_t endQuery;
+	};
+
+	struct FrameQueries {
+		VkQueryPool pool{ VK_NULL_HANDLE };
+		std::vector<Scope> scopes;
+		uint32_t queryCount{ 0 };
+		bool hasResults{ false };
+	};
+
+	std::vector<FrameQueries> _frames;
+	FrameQueries* _current{ nullptr };
+	uint32_t _depth{ 0 };
+
+	bool _supported{ false };
+	float _timestampPeriod{ 1.0f };
+	uint64_t _timestampMask{ ~0ull };
+
+	std::vector<uint64_t> _timestamps;
+	std::vector<ScopeResult> _results;
+};
+
+// writes a begin timestamp on construction and the matching end timestamp on destruction
+class ScopedGpuTimer {
+public:
+	ScopedGpuTimer(GpuProfiler& profiler, VkCommandBuffer cmd, const char* name)
+		: _profiler(profiler), _cmd(cmd), _scope(profiler.begin_scope(cmd, name)) {}
+	~ScopedGpuTimer() { _profiler.end_scope(_cmd, _scope); }
+
+	ScopedGpuTimer(const ScopedGpuTimer&) = delete;
+	ScopedGpuTimer& operator=(const ScopedGpuTimer&) = delete;
+
+private:
+	GpuProfiler& _profiler;
+	VkCommandBuffer _cmd;
+	uint32_t _scope;
+};
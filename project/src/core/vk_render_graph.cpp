@@ -0,0 +1,238 @@
+#include "vk_render_graph.h"
+#include "vk_initializers.h"
+
+#include <queue>
+
+constexpr VkAccessFlags2 WRITE_ACCESS_MASK =
+	VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT
+	| VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+	| VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+	| VK_ACCESS_2_SHADER_WRITE_BIT
+	| VK_ACCESS_2_TRANSFER_WRITE_BIT
+	| VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+RenderGraph::Pass& RenderGraph::Pass::read(RenderGraphImage image, ImageUsage usage)
+{
+	_accesses.push_back({ image, usage, false });
+	return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::write(RenderGraphImage image, ImageUsage usage)
+{
+	_accesses.push_back({ image, usage, true });
+	return *this;
+}
+
+void RenderGraph::reset()
+{
+	_images.clear();
+	// passes are reused in place so references handed out by add_pass stay valid while building
+	for (uint32_t i = 0; i < _passCount; i++) {
+		_passes[i]._accesses.clear();
+		_passes[i]._execute = nullptr;
+	}
+	_passCount = 0;
+	_compiled.clear();
+	_finalBarriers.clear();
+	_culledPassCount = 0;
+}
+
+RenderGraphImage RenderGraph::import_image(const char* name, VkImage image, VkImageAspectFlags aspect
+	, VkImageLayout initialLayout, VkPipelineStageFlags2 initialStage)
+{
+	Image newImage{};
+	newImage.name = name;
+	newImage.image = image;
+	newImage.aspect = aspect;
+	newImage.initialState = { initialLayout, initialStage, VK_ACCESS_2_NONE, false };
+	newImage.exported = false;
+	newImage.finalLayout = initialLayout;
+	_images.push_back(newImage);
+	return static_cast<RenderGraphImage>(_images.size() - 1);
+}
+
+void RenderGraph::export_image(RenderGraphImage image, VkImageLayout finalLayout)
+{
+	_images[image].exported = true;
+	_images[image].finalLayout = finalLayout;
+}
+
+RenderGraph::Pass& RenderGraph::add_pass(const char* name, std::function<void(VkCommandBuffer cmd)>&& execute)
+{
+	if (_passCount == _passes.size()) { _passes.emplace_back(); }
+	Pass& pass = _passes[_passCount++];
+	pass._name = name;
+	pass._execute = std::move(execute);
+	return pass;
+}
+
+void RenderGraph::compile()
+{
+	order_passes();
+	cull_passes();
+	derive_barriers();
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd, GpuProfiler* profiler)
+{
+	for (CompiledPass& compiled : _compiled) {
+		compiled.barriers.flush(cmd);
+
+		Pass& pass = _passes[compiled.pass];
+		if (profiler) {
+			ScopedGpuTimer timer(*profiler, cmd, pass._name);
+			pass._execute(cmd);
+		}
+		else {
+			pass._execute(cmd);
+		}
+	}
+
+	_finalBarriers.flush(cmd);
+}
+
+void RenderGraph::order_passes()
+{
+	// per image: the last writer must precede later readers/writers (RAW/WAW)
+	//  and readers since that write must precede the next writer (WAR)
+	std::vector<std::vector<uint32_t>> edges(_passCount);
+	std::vector<uint32_t> inDegree(_passCount, 0);
+	std::vector<int> lastWriter(_images.size(), -1);
+	std::vector<std::vector<uint32_t>> readers(_images.size());
+
+	auto add_edge = [&](uint32_t from, uint32_t to) {
+		if (from == to) { return; }
+		edges[from].push_back(to);
+		inDegree[to]++;
+		};
+
+	for (uint32_t p = 0; p < _passCount; p++) {
+		for (const Pass::Access& access : _passes[p]._accesses) {
+			if (lastWriter[access.image] >= 0) { add_edge(static_cast<uint32_t>(lastWriter[access.image]), p); }
+			if (access.write) {
+				for (uint32_t reader : readers[access.image]) { add_edge(reader, p); }
+				readers[access.image].clear();
+				lastWriter[access.image] = static_cast<int>(p);
+			}
+			else {
+				readers[access.image].push_back(p);
+			}
+		}
+	}
+
+	// Kahn's algorithm, ties broken by declaration order
+	std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+	for (uint32_t p = 0; p < _passCount; p++) {
+		if (inDegree[p] == 0) { ready.push(p); }
+	}
+
+	_order.clear();
+	while (!ready.empty()) {
+		uint32_t p = ready.top();
+		ready.pop();
+		_order.push_back(p);
+		for (uint32_t next : edges[p]) {
+			if (--inDegree[next] == 0) { ready.push(next); }
+		}
+	}
+}
+
+void RenderGraph::cull_passes()
+{
+	// walk backwards from the exported images, a pass is alive if it writes something still needed
+	std::vector<bool> needed(_images.size(), false);
+	for (size_t i = 0; i < _images.size(); i++) { needed[i] = _images[i].exported; }
+
+	_alive.assign(_passCount, false);
+	for (auto it = _order.rbegin(); it != _order.rend(); it++) {
+		const Pass& pass = _passes[*it];
+		for (const Pass::Access& access : pass._accesses) {
+			if (access.write && needed[access.image]) { _alive[*it] = true; break; }
+		}
+		if (!_alive[*it]) { continue; }
+
+		for (const Pass::Access& access : pass._accesses) {
+			// attachments are loaded, so a write also depends on the previous contents
+			if (!access.write || access.usage == ImageUsage::ColorAttachment || access.usage == ImageUsage::DepthAttachment) {
+				needed[access.image] = true;
+			}
+		}
+	}
+}
+
+void RenderGraph::derive_barriers()
+{
+	std::vector<ImageState> states(_images.size());
+	for (size_t i = 0; i < _images.size(); i++) { states[i] = _images[i].initialState; }
+
+	auto add_barrier = [&](vkutil::BarrierBuilder& builder, RenderGraphImage image, const ImageState& from, const ImageState& to) {
+		// only writes need to be made available, read -> write is an execution dependency
+		VkAccessFlags2 srcAccess = from.written ? (from.access & WRITE_ACCESS_MASK) : VK_ACCESS_2_NONE;
+		builder.image(_images[image].image, from.layout, to.layout, from.stage, srcAccess, to.stage, to.access
+			, vkinit::image_subresource_range(_images[image].aspect));
+		};
+
+	_compiled.clear();
+	for (uint32_t p : _order) {
+		if (!_alive[p]) {
+			_culledPassCount++;
+			continue;
+		}
+
+		CompiledPass compiled{ p, {} };
+		for (const Pass::Access& access : _passes[p]._accesses) {
+			ImageState& current = states[access.image];
+			ImageState next = get_usage_state(access.usage, access.write);
+
+			bool hazard = current.written || next.written || current.layout != next.layout;
+			if (!hazard) {
+				// read after read in the same layout, later writers must wait on every reader
+				current.stage |= next.stage;
+				current.access |= next.access;
+				continue;
+			}
+
+			add_barrier(compiled.barriers, access.image, current, next);
+			current = next;
+		}
+		_compiled.push_back(std::move(compiled));
+	}
+
+	_finalBarriers.clear();
+	for (RenderGraphImage i = 0; i < _images.size(); i++) {
+		if (!_images[i].exported || states[i].layout == _images[i].finalLayout) { continue; }
+		ImageState finalState{ _images[i].finalLayout, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, false };
+		add_barrier(_finalBarriers, i, states[i], finalState);
+	}
+}
+
+RenderGraph::ImageState RenderGraph::get_usage_state(ImageUsage usage, bool write)
+{
+	switch (usage) {
+	case ImageUsage::ColorAttachment:
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT
+			, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | (write ? VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_2_NONE), write };
+	case ImageUsage::DepthAttachment:
+		return { VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL
+			, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT
+			, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | (write ? VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : VK_ACCESS_2_NONE), write };
+	case ImageUsage::Sampled:
+		return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+			, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+			, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, false };
+	case ImageUsage::StorageRead:
+		return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+			, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, false };
+	case ImageUsage::StorageWrite:
+		return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+			, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, true };
+	case ImageUsage::TransferSrc:
+		return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT
+			, VK_ACCESS_2_TRANSFER_READ_BIT, false };
+	case ImageUsage::TransferDst:
+		return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT
+			, VK_ACCESS_2_TRANSFER_WRITE_BIT, true };
+	}
+	return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT
+		, VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT, true };
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "big_header.h"
+#include "vk_profiler.h"
+#include "vk_barriers.h"
+
+// how a pass touches an image, determines layout, stages and access masks
+enum class ImageUsage {
+	ColorAttachment,
+	DepthAttachment,
+	Sampled,
+	StorageRead,
+	StorageWrite,
+	TransferSrc,
+	TransferDst,
+};
+
+using RenderGraphImage = uint32_t;
+
+// Per-frame graph of passes over imported images.
+//  Passes declare the images they read and write. compile() orders the passes, culls the ones that
+//  don't contribute to an exported image and derives the layout transitions/barriers between them.
+//  Declaration order is the logical order for passes touching the same image; independent passes may move.
+class RenderGraph {
+public:
+	class Pass {
+	public:
+		Pass& read(RenderGraphImage image, ImageUsage usage);
+		Pass& write(RenderGraphImage image, ImageUsage usage);
+
+	private:
+		friend class RenderGraph;
+		struct Access {
+			RenderGraphImage image;
+			ImageUsage usage;
+			bool write;
+		};
+
+		const char* _name;
+		std::function<void(VkCommandBuffer cmd)> _execute;
+		std::vector<Access> _accesses;
+	};
+
+	// clears passes and images, keeps allocations for the next frame
+	void reset();
+
+	// initialStage is the stage the image's current contents/layout are synchronized with,
+	//  e.g. the stage a swapchain acquire semaphore is waited on
+	RenderGraphImage import_image(const char* name, VkImage image, VkImageAspectFlags aspect
+		, VkImageLayout initialLayout, VkPipelineStageFlags2 initialStage = VK_PIPELINE_STAGE_2_NONE);
+	// exported images are the graph's outputs, they are transitioned to finalLayout at the end
+	void export_image(RenderGraphImage image, VkImageLayout finalLayout);
+
+	Pass& add_pass(const char* name, std::function<void(VkCommandBuffer cmd)>&& execute);
+
+	void compile();
+	// each pass is wrapped in a GPU timer scope named after the pass when a profiler is given
+	void execute(VkCommandBuffer cmd, GpuProfiler* profiler = nullptr);
+
+	uint32_t get_culled_pass_count() const { return _culledPassCount; }
+
+private:
+	struct ImageState {
+		VkImageLayout layout;
+		VkPipelineStageFlags2 stage;
+		VkAccessFlags2 access;
+		bool written;
+	};
+
+	struct Image {
+		const char* name;
+		VkImage image;
+		VkImageAspectFlags aspect;
+		ImageState initialState;
+		bool exported;
+		VkImageLayout finalLayout;
+	};
+
+	struct CompiledPass {
+		uint32_t pass;
+		vkutil::BarrierBuilder barriers;
+	};
+
+	void order_passes();
+	void cull_passes();
+	void derive_barriers();
+	static ImageState get_usage_state(ImageUsage usage, bool write);
+
+	std::vector<Image> _images;
+	std::deque<Pass> _passes;
+	uint32_t _passCount{ 0 };
+
+	std::vector<uint32_t> _order;
+	std::vector<bool> _alive;
+	std::vector<CompiledPass> _compiled;
+	vkutil::BarrierBuilder _finalBarriers;
+	uint32_t _culledPassCount{ 0 };
+};
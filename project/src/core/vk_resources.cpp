@@ -0,0 +1,186 @@
+#include "vk_resources.h"
+
+uint32_t HandleAllocator::allocate(uint32_t& generation)
+{
+	uint32_t index;
+	if (!_freeSlots.empty()) {
+		index = _freeSlots.back();
+		_freeSlots.pop_back();
+	}
+	else {
+		if (_generations.size() >= MAX_SLOTS) {
+			fmt::print("Resource registry: out of handle slots ({})\n", MAX_SLOTS);
+			abort();
+		}
+		index = static_cast<uint32_t>(_generations.size());
+		_generations.push_back(1);
+	}
+	generation = _generations[index];
+	return index;
+}
+
+void HandleAllocator::free(uint32_t index)
+{
+	// generation 0 is never handed out, so the null handle can't match slot 0
+	uint32_t next = (_generations[index] + 1) & ImageHandle::GENERATION_MASK;
+	_generations[index] = next == 0 ? 1 : next;
+	_freeSlots.push_back(index);
+}
+
+void HandleAllocator::clear()
+{
+	_generations.clear();
+	_freeSlots.clear();
+}
+
+ImageHandle ResourceRegistry::add_image(const AllocatedImage& image)
+{
+	uint32_t generation;
+	uint32_t index = _imageSlots.allocate(generation);
+	if (index == _images.size()) {
+		_images.push_back(image.image);
+		_imageViews.push_back(image.imageView);
+		_imageAllocations.push_back(image.allocation);
+		_imageExtents.push_back(image.imageExtent);
+		_imageFormats.push_back(image.imageFormat);
+		_imageMipLevels.push_back(image.mipLevels);
+		_imageUsages.push_back(image.imageUsage);
+	}
+	else {
+		_images[index] = image.image;
+		_imageViews[index] = image.imageView;
+		_imageAllocations[index] = image.allocation;
+		_imageExtents[index] = image.imageExtent;
+		_imageFormats[index] = image.imageFormat;
+		_imageMipLevels[index] = image.mipLevels;
+		_imageUsages[index] = image.imageUsage;
+	}
+	if (image.allocation != VK_NULL_HANDLE) { _imageAllocationSlots[image.allocation] = index; }
+	return ImageHandle::make(index, generation);
+}
+
+AllocatedImage ResourceRegistry::remove_image(ImageHandle handle)
+{
+	check(handle);
+	uint32_t index = handle.index();
+	AllocatedImage image{ _images[index], _imageViews[index], _imageAllocations[index], _imageExtents[index], _imageFormats[index]
+		, _imageMipLevels[index], _imageUsages[index] };
+	if (image.allocation != VK_NULL_HANDLE) { _imageAllocationSlots.erase(image.allocation); }
+	_images[index] = VK_NULL_HANDLE;
+	_imageViews[index] = VK_NULL_HANDLE;
+	_imageAllocations[index] = VK_NULL_HANDLE;
+	_imageSlots.free(index);
+	return image;
+}
+
+ImageHandle ResourceRegistry::find_image(VmaAllocation allocation) const
+{
+	auto it = _imageAllocationSlots.find(allocation);
+	if (it == _imageAllocationSlots.end()) { return {}; }
+	return ImageHandle::make(it->second, _imageSlots.get_generation(it->second));
+}
+
+void ResourceRegistry::replace_image(ImageHandle handle, VkImage image, VkImageView imageView)
+{
+	check(handle);
+	_images[handle.index()] = image;
+	_imageViews[handle.index()] = imageView;
+}
+
+void ResourceRegistry::retire_image(ImageHandle handle, ResourceDeletionQueue& deletionQueue)
+{
+	deletionQueue.push(remove_image(handle));
+}
+
+BufferHandle ResourceRegistry::add_buffer(const AllocatedBuffer& buffer)
+{
+	uint32_t generation;
+	uint32_t index = _bufferSlots.allocate(generation);
+	if (index == _buffers.size()) {
+		_buffers.push_back(buffer.buffer);
+		_bufferAllocations.push_back(buffer.allocation);
+		_bufferInfos.push_back(buffer.info);
+		_bufferUsages.push_back(buffer.usage);
+		_bufferSizes.push_back(buffer.size);
+	}
+	else {
+		_buffers[index] = buffer.buffer;
+		_bufferAllocations[index] = buffer.allocation;
+		_bufferInfos[index] = buffer.info;
+		_bufferUsages[index] = buffer.usage;
+		_bufferSizes[index] = buffer.size;
+	}
+	if (buffer.allocation != VK_NULL_HANDLE) { _bufferAllocationSlots[buffer.allocation] = index; }
+	return BufferHandle::make(index, generation);
+}
+
+AllocatedBuffer ResourceRegistry::remove_buffer(BufferHandle handle)
+{
+	check(handle);
+	uint32_t index = handle.index();
+	AllocatedBuffer buffer{ _buffers[index], _bufferAllocations[index], _bufferInfos[index], _bufferUsages[index], _bufferSizes[index] };
+	if (buffer.allocation != VK_NULL_HANDLE) { _bufferAllocationSlots.erase(buffer.allocation); }
+	_buffers[index] = VK_NULL_HANDLE;
+	_bufferAllocations[index] = VK_NULL_HANDLE;
+	_bufferInfos[index] = {};
+	_bufferSlots.free(index);
+	return buffer;
+}
+
+BufferHandle ResourceRegistry::find_buffer(VmaAllocation allocation) const
+{
+	auto it = _bufferAllocationSlots.find(allocation);
+	if (it == _bufferAllocationSlots.end()) { return {}; }
+	return BufferHandle::make(it->second, _bufferSlots.get_generation(it->second));
+}
+
+void ResourceRegistry::replace_buffer(BufferHandle handle, VkBuffer buffer)
+{
+	check(handle);
+	_buffers[handle.index()] = buffer;
+}
+
+void ResourceRegistry::retire_buffer(BufferHandle handle, ResourceDeletionQueue& deletionQueue)
+{
+	deletionQueue.push(remove_buffer(handle));
+}
+
+void ResourceRegistry::destroy()
+{
+	if (_imageSlots.live_count() > 0 || _bufferSlots.live_count() > 0) {
+		fmt::print("Resource registry destroyed with {} images and {} buffers still registered\n"
+			, _imageSlots.live_count(), _bufferSlots.live_count());
+	}
+	_imageSlots.clear();
+	_images.clear();
+	_imageViews.clear();
+	_imageAllocations.clear();
+	_imageExtents.clear();
+	_imageFormats.clear();
+	_imageMipLevels.clear();
+	_imageUsages.clear();
+	_imageAllocationSlots.clear();
+	_bufferSlots.clear();
+	_buffers.clear();
+	_bufferAllocations.clear();
+	_bufferInfos.clear();
+	_bufferUsages.clear();
+	_bufferSizes.clear();
+	_bufferAllocationSlots.clear();
+}
+
+void ResourceRegistry::check(ImageHandle handle) const
+{
+	if (!is_valid(handle)) {
+		fmt::print("Stale or null image handle (index {}, generation {})\n", handle.index(), handle.generation());
+		abort();
+	}
+}
+
+void ResourceRegistry::check(BufferHandle handle) const
+{
+	if (!is_valid(handle)) {
+		fmt::print("Stale or null buffer handle (index {}, generation {})\n", handle.index(), handle.generation());
+		abort();
+	}
+}
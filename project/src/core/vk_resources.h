@@ -0,0 +1,116 @@
+#pragma once
+#include "big_header.h"
+#include "vk_types.h"
+#include "vk_deletion_queue.h"
+
+// 32 bit generational handle: the low INDEX_BITS are the slot, the rest count how often the slot was reused.
+//  A handle whose generation no longer matches its slot is stale. 0 is the null handle.
+//  The index is stable for the resource's lifetime, so it can double as a bindless array index.
+template<typename Tag>
+struct ResourceHandle {
+	static constexpr uint32_t INDEX_BITS = 20;
+	static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+	static constexpr uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+
+	uint32_t value{ 0 };
+
+	uint32_t index() const { return value & INDEX_MASK; }
+	uint32_t generation() const { return value >> INDEX_BITS; }
+	bool is_null() const { return value == 0; }
+
+	static ResourceHandle make(uint32_t index, uint32_t generation) { return { (generation << INDEX_BITS) | index }; }
+
+	bool operator==(const ResourceHandle& other) const { return value == other.value; }
+	bool operator!=(const ResourceHandle& other) const { return value != other.value; }
+};
+
+using ImageHandle = ResourceHandle<struct ImageHandleTag>;
+using BufferHandle = ResourceHandle<struct BufferHandleTag>;
+
+// Slot bookkeeping shared by the registry's tables: generations and a LIFO free list
+class HandleAllocator {
+public:
+	static constexpr uint32_t MAX_SLOTS = ImageHandle::INDEX_MASK + 1;
+
+	// returns the slot to use, growing the table by one if none was free
+	uint32_t allocate(uint32_t& generation);
+	void free(uint32_t index);
+	bool is_valid(uint32_t index, uint32_t generation) const { return index < _generations.size() && _generations[index] == generation; }
+	uint32_t get_generation(uint32_t index) const { return _generations[index]; }
+	uint32_t size() const { return static_cast<uint32_t>(_generations.size()); }
+	uint32_t live_count() const { return size() - static_cast<uint32_t>(_freeSlots.size()); }
+	void clear();
+
+private:
+	std::vector<uint32_t> _generations;
+	std::vector<uint32_t> _freeSlots;
+};
+
+// Owns the lookup tables for images and buffers behind generational handles.
+//  Tables are stored SoA so per-draw lookups (views, buffers) only touch the columns they need.
+//  The registry does not destroy anything: remove_* hands the resource back to the caller,
+//  retire_* pushes it into a deletion queue. Looking up a stale handle aborts.
+//  While the GpuDefragmenter runs, resources are retired through it instead, it may still be moving them.
+class ResourceRegistry {
+public:
+	ImageHandle add_image(const AllocatedImage& image);
+	// invalidates the handle and returns the image, for resources the caller destroys or another owner frees
+	AllocatedImage remove_image(ImageHandle handle);
+	// invalidates the handle and destroys the image once the queue's frame retires
+	void retire_image(ImageHandle handle, ResourceDeletionQueue& deletionQueue);
+	bool is_valid(ImageHandle handle) const { return !handle.is_null() && _imageSlots.is_valid(handle.index(), handle.generation()); }
+
+	VkImage get_image(ImageHandle handle) const { check(handle); return _images[handle.index()]; }
+	VkImageView get_image_view(ImageHandle handle) const { check(handle); return _imageViews[handle.index()]; }
+	VkExtent3D get_image_extent(ImageHandle handle) const { check(handle); return _imageExtents[handle.index()]; }
+	VkFormat get_image_format(ImageHandle handle) const { check(handle); return _imageFormats[handle.index()]; }
+	uint32_t get_image_mip_levels(ImageHandle handle) const { check(handle); return _imageMipLevels[handle.index()]; }
+	VkImageUsageFlags get_image_usage(ImageHandle handle) const { check(handle); return _imageUsages[handle.index()]; }
+	VmaAllocation get_image_allocation(ImageHandle handle) const { check(handle); return _imageAllocations[handle.index()]; }
+	// the image bound to allocation, null if none is registered (draw images don't own their memory)
+	ImageHandle find_image(VmaAllocation allocation) const;
+	// swaps in a copy of the image bound to the same allocation, the caller destroys the old image and view
+	void replace_image(ImageHandle handle, VkImage image, VkImageView imageView);
+
+	BufferHandle add_buffer(const AllocatedBuffer& buffer);
+	AllocatedBuffer remove_buffer(BufferHandle handle);
+	void retire_buffer(BufferHandle handle, ResourceDeletionQueue& deletionQueue);
+	bool is_valid(BufferHandle handle) const { return !handle.is_null() && _bufferSlots.is_valid(handle.index(), handle.generation()); }
+
+	VkBuffer get_buffer(BufferHandle handle) const { check(handle); return _buffers[handle.index()]; }
+	const VmaAllocationInfo& get_buffer_info(BufferHandle handle) const { check(handle); return _bufferInfos[handle.index()]; }
+	VkBufferUsageFlags get_buffer_usage(BufferHandle handle) const { check(handle); return _bufferUsages[handle.index()]; }
+	// size the buffer was created with, get_buffer_info().size is the allocation's and may be larger
+	VkDeviceSize get_buffer_size(BufferHandle handle) const { check(handle); return _bufferSizes[handle.index()]; }
+	VmaAllocation get_buffer_allocation(BufferHandle handle) const { check(handle); return _bufferAllocations[handle.index()]; }
+	BufferHandle find_buffer(VmaAllocation allocation) const;
+	void replace_buffer(BufferHandle handle, VkBuffer buffer);
+
+	uint32_t get_image_count() const { return _imageSlots.live_count(); }
+	uint32_t get_buffer_count() const { return _bufferSlots.live_count(); }
+
+	// resources still registered are leaked, reported so they can be tracked down
+	void destroy();
+
+private:
+	void check(ImageHandle handle) const;
+	void check(BufferHandle handle) const;
+
+	HandleAllocator _imageSlots;
+	std::vector<VkImage> _images;
+	std::vector<VkImageView> _imageViews;
+	std::vector<VmaAllocation> _imageAllocations;
+	std::vector<VkExtent3D> _imageExtents;
+	std::vector<VkFormat> _imageFormats;
+	std::vector<uint32_t> _imageMipLevels;
+	std::vector<VkImageUsageFlags> _imageUsages;
+	std::unordered_map<VmaAllocation, uint32_t> _imageAllocationSlots;
+
+	HandleAllocator _bufferSlots;
+	std::vector<VkBuffer> _buffers;
+	std::vector<VmaAllocation> _bufferAllocations;
+	std::vector<VmaAllocationInfo> _bufferInfos;
+	std::vector<VkBufferUsageFlags> _bufferUsages;
+	std::vector<VkDeviceSize> _bufferSizes;
+	std::unordered_map<VmaAllocation, uint32_t> _bufferAllocationSlots;
+};
@@ -0,0 +1,68 @@
+#include "vk_staging_ring.h"
+
+void StagingRing::init(VmaAllocator allocator, MemoryPools& memoryPools, VkDeviceSize capacity)
+{
+	_allocator = allocator;
+	_capacity = capacity;
+
+	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.pNext = nullptr;
+	bufferInfo.size = capacity;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+	VmaAllocationCreateInfo vmaallocInfo = {};
+	vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	vmaallocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	VK_CHECK(memoryPools.create_buffer(MemoryClass::Streaming, bufferInfo, vmaallocInfo, _buffer));
+}
+
+void StagingRing::destroy()
+{
+	vmaDestroyBuffer(_allocator, _buffer.buffer, _buffer.allocation);
+	_buffer = {};
+	_regions.clear();
+	_head = 0;
+	_used = 0;
+	_unsubmitted = 0;
+}
+
+bool StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment, StagingAllocation& allocation)
+{
+	if (size > _capacity) { return false; }
+	// nothing is live, start over instead of padding to the end
+	if (_used == 0) { _head = 0; }
+
+	VkDeviceSize offset = (_head + alignment - 1) / alignment * alignment;
+	if (offset + size > _capacity) {
+		// wrap around, the tail of the buffer is padding owned by this allocation
+		offset = 0;
+	}
+	VkDeviceSize required = offset >= _head ? offset + size - _head : _capacity - _head + size;
+	if (_used + required > _capacity) { return false; }
+
+	_head = offset + size;
+	if (_head == _capacity) { _head = 0; }
+	_used += required;
+	_unsubmitted += required;
+
+	allocation.buffer = _buffer.buffer;
+	allocation.offset = offset;
+	allocation.mapped = static_cast<char*>(_buffer.info.pMappedData) + offset;
+	return true;
+}
+
+void StagingRing::submit(uint64_t retireValue)
+{
+	if (_unsubmitted == 0) { return; }
+	_regions.push_back({ retireValue, _unsubmitted });
+	_unsubmitted = 0;
+}
+
+void StagingRing::reclaim(uint64_t completedValue)
+{
+	while (!_regions.empty() && _regions.front().retireValue <= completedValue) {
+		_used -= _regions.front().size;
+		_regions.pop_front();
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "big_header.h"
+#include "vk_types.h"
+#include "vk_memory_pools.h"
+
+struct StagingAllocation {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	void* mapped;
+};
+
+// Persistently mapped ring buffer for staging uploads.
+//  Allocations are handed out in order and grouped by the timeline value of the submission that reads them,
+//  a group's space is reclaimed once that value has been reached.
+class StagingRing {
+public:
+	void init(VmaAllocator allocator, MemoryPools& memoryPools, VkDeviceSize capacity);
+	void destroy();
+
+	// returns false if the ring can't fit size right now, reclaim() after the oldest submission retires and retry
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, StagingAllocation& allocation);
+	// allocations made since the last submit are read by the submission that signals retireValue
+	void submit(uint64_t retireValue);
+	void reclaim(uint64_t completedValue);
+
+	VkDeviceSize get_capacity() const { return _capacity; }
+	VkDeviceSize get_used() const { return _used; }
+
+private:
+	struct Region {
+		uint64_t retireValue;
+		VkDeviceSize size;
+	};
+
+	VmaAllocator _allocator{ VK_NULL_HANDLE };
+	AllocatedBuffer _buffer{};
+	VkDeviceSize _capacity{ 0 };
+	// next free byte, bytes in use from the oldest live region up to _head (including padding at the wrap)
+	VkDeviceSize _head{ 0 };
+	VkDeviceSize _used{ 0 };
+	VkDeviceSize _unsubmitted{ 0 };
+	std::deque<Region> _regions;
+};
@@ -0,0 +1,143 @@
+#include "vk_transient_pool.h"
+#include "vk_initializers.h"
+
+void TransientImagePool::init(VkDevice device, VkPhysicalDevice physicalDevice, VmaAllocator allocator, MemoryPools& memoryPools)
+{
+	_device = device;
+	_allocator = allocator;
+	_memoryPools = &memoryPools;
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	_lazyMemorySupported = false;
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+			_lazyMemorySupported = true;
+		}
+	}
+}
+
+TransientImage TransientImagePool::add_image(const VkImageCreateInfo& createInfo, VkImageAspectFlags aspect, uint32_t firstPass, uint32_t lastPass)
+{
+	Image image{};
+	image.createInfo = createInfo;
+	image.aspect = aspect;
+	image.firstPass = firstPass;
+	image.lastPass = lastPass;
+	image.image.imageFormat = createInfo.format;
+	image.image.imageExtent = createInfo.extent;
+	image.image.mipLevels = createInfo.mipLevels;
+	image.image.imageUsage = createInfo.usage;
+	_images.push_back(image);
+	return static_cast<TransientImage>(_images.size() - 1);
+}
+
+void TransientImagePool::build()
+{
+	_requestedSize = 0;
+	_allocatedSize = 0;
+	_lazyCount = 0;
+
+	std::vector<VkMemoryRequirements> requirements(_images.size());
+	for (size_t i = 0; i < _images.size(); i++) {
+		VK_CHECK(vkCreateImage(_device, &_images[i].createInfo, nullptr, &_images[i].image.image));
+		vkGetImageMemoryRequirements(_device, _images[i].image.image, &requirements[i]);
+		_requestedSize += requirements[i].size;
+	}
+
+	// largest first, each image joins the first slot whose images are all dead during its passes
+	std::vector<uint32_t> order(_images.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return requirements[a].size > requirements[b].size; });
+
+	auto overlaps = [&](const Image& a, const Image& b) {
+		return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+		};
+
+	for (uint32_t index : order) {
+		const Image& image = _images[index];
+		// lazily allocated memory is never really committed, so there is nothing to gain from sharing it
+		bool lazy = _lazyMemorySupported && (image.createInfo.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+
+		MemorySlot* target = nullptr;
+		if (!lazy) {
+			for (MemorySlot& slot : _slots) {
+				if (slot.lazy || (slot.requirements.memoryTypeBits & requirements[index].memoryTypeBits) == 0) { continue; }
+				bool free = std::none_of(slot.images.begin(), slot.images.end(), [&](uint32_t other) { return overlaps(image, _images[other]); });
+				if (free) { target = &slot; break; }
+			}
+		}
+
+		if (target) {
+			target->requirements.size = std::max(target->requirements.size, requirements[index].size);
+			target->requirements.alignment = std::max(target->requirements.alignment, requirements[index].alignment);
+			target->requirements.memoryTypeBits &= requirements[index].memoryTypeBits;
+			target->images.push_back(index);
+		}
+		else {
+			_slots.push_back({ requirements[index], lazy, { index }, VK_NULL_HANDLE });
+		}
+	}
+
+	for (MemorySlot& slot : _slots) {
+		VmaAllocationCreateInfo allocInfo = {};
+		if (slot.lazy) {
+			allocInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+			allocInfo.requiredFlags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			// from the default pools, the render target pool's memory type isn't lazily allocated
+			// the image's memory types may not include the lazy ones
+			if (vmaAllocateMemory(_allocator, &slot.requirements, &allocInfo, &slot.allocation, nullptr) != VK_SUCCESS) {
+				slot.lazy = false;
+			}
+		}
+		if (!slot.lazy) {
+			allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+			allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			VK_CHECK(_memoryPools->allocate(MemoryClass::RenderTargets, slot.requirements, allocInfo, &slot.allocation));
+		}
+
+		if (slot.lazy) { _lazyCount++; }
+		else { _allocatedSize += slot.requirements.size; }
+
+		for (uint32_t index : slot.images) {
+			Image& image = _images[index];
+			VK_CHECK(vmaBindImageMemory(_allocator, slot.allocation, image.image.image));
+
+			VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(image.createInfo.format, image.image.image, image.aspect);
+			VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &image.image.imageView));
+			image.image.allocation = VK_NULL_HANDLE;
+		}
+	}
+}
+
+void TransientImagePool::destroy()
+{
+	for (Image& image : _images) {
+		if (image.image.imageView != VK_NULL_HANDLE) { vkDestroyImageView(_device, image.image.imageView, nullptr); }
+		if (image.image.image != VK_NULL_HANDLE) { vkDestroyImage(_device, image.image.image, nullptr); }
+	}
+	for (MemorySlot& slot : _slots) {
+		if (slot.allocation != VK_NULL_HANDLE) { vmaFreeMemory(_allocator, slot.allocation); }
+	}
+	_images.clear();
+	_slots.clear();
+	_requestedSize = 0;
+	_allocatedSize = 0;
+	_lazyCount = 0;
+}
+
+void TransientImagePool::retire(ResourceDeletionQueue& deletionQueue)
+{
+	for (Image& image : _images) {
+		if (image.image.imageView != VK_NULL_HANDLE) { deletionQueue.push(image.image.imageView); }
+		if (image.image.image != VK_NULL_HANDLE) { deletionQueue.push(image.image.image); }
+	}
+	for (MemorySlot& slot : _slots) {
+		if (slot.allocation != VK_NULL_HANDLE) { deletionQueue.push(slot.allocation); }
+	}
+	_images.clear();
+	_slots.clear();
+	_requestedSize = 0;
+	_allocatedSize = 0;
+	_lazyCount = 0;
+}
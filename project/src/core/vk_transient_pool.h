@@ -0,0 +1,63 @@
+#pragma once
+#include "big_header.h"
+#include "vk_types.h"
+#include "vk_deletion_queue.h"
+#include "vk_memory_pools.h"
+
+using TransientImage = uint32_t;
+
+// Render targets that only live for part of a frame.
+//  Each image declares the inclusive range of passes it is used in. build() packs images whose ranges
+//  don't overlap into the same memory, and puts TRANSIENT_ATTACHMENT images into lazily allocated
+//  memory when the device has it (tile based GPUs never back those with real memory).
+//  Images sharing memory start every frame with undefined contents; the barrier that first uses an
+//  image has to wait on the last use of every other image in the same memory.
+class TransientImagePool {
+public:
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, VmaAllocator allocator, MemoryPools& memoryPools);
+
+	TransientImage add_image(const VkImageCreateInfo& createInfo, VkImageAspectFlags aspect, uint32_t firstPass, uint32_t lastPass);
+	// creates and binds every added image
+	void build();
+	// destroys the images and their memory, images can be added and built again afterwards
+	void destroy();
+	// hands the images and their memory to a deletion queue instead, for images frames in flight may still use
+	void retire(ResourceDeletionQueue& deletionQueue);
+
+	// the returned image doesn't own its allocation, it is freed by destroy()
+	AllocatedImage get_image(TransientImage image) const { return _images[image].image; }
+	bool supports_lazy_memory() const { return _lazyMemorySupported; }
+
+	// sum of the images' memory requirements vs what was actually allocated
+	VkDeviceSize get_requested_size() const { return _requestedSize; }
+	VkDeviceSize get_allocated_size() const { return _allocatedSize; }
+	uint32_t get_lazy_count() const { return _lazyCount; }
+
+private:
+	struct Image {
+		VkImageCreateInfo createInfo;
+		VkImageAspectFlags aspect;
+		uint32_t firstPass;
+		uint32_t lastPass;
+		AllocatedImage image;
+	};
+
+	struct MemorySlot {
+		VkMemoryRequirements requirements;
+		bool lazy;
+		std::vector<uint32_t> images;
+		VmaAllocation allocation;
+	};
+
+	VkDevice _device{ VK_NULL_HANDLE };
+	VmaAllocator _allocator{ VK_NULL_HANDLE };
+	MemoryPools* _memoryPools{ nullptr };
+	bool _lazyMemorySupported{ false };
+
+	std::vector<Image> _images;
+	std::vector<MemorySlot> _slots;
+
+	VkDeviceSize _requestedSize{ 0 };
+	VkDeviceSize _allocatedSize{ 0 };
+	uint32_t _lazyCount{ 0 };
+};
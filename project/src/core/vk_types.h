@@ -7,10 +7,15 @@ struct AllocatedImage {
 	VmaAllocation allocation;
 	VkExtent3D imageExtent;
 	VkFormat imageFormat;
+	uint32_t mipLevels;
+	VkImageUsageFlags imageUsage;
 };
 
 struct AllocatedBuffer {
 	VkBuffer buffer;
 	VmaAllocation allocation;
 	VmaAllocationInfo info;
+	VkBufferUsageFlags usage;
+	// VkBufferCreateInfo::size, info.size is the allocation's and may be larger
+	VkDeviceSize size;
 };
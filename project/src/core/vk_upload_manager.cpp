@@ -0,0 +1,367 @@
+#include "vk_upload_manager.h"
+#include "vk_images.h"
+
+// the acquiring submission waits on the upload timeline here, acquire barriers chain onto the wait.
+//  only completed uploads are acquired, so the wait never stalls the frame
+constexpr VkPipelineStageFlags2 ACQUIRE_WAIT_STAGE = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+void UploadManager::init(VkDevice device, VmaAllocator allocator, MemoryPools& memoryPools
+	, VkQueue transferQueue, uint32_t transferQueueFamily
+	, VkQueue graphicsQueue, uint32_t graphicsQueueFamily)
+{
+	_device = device;
+	_allocator = allocator;
+	_memoryPools = &memoryPools;
+	_graphicsQueueFamily = graphicsQueueFamily;
+	_dedicated = transferQueue != VK_NULL_HANDLE && transferQueueFamily != graphicsQueueFamily;
+	_queue = _dedicated ? transferQueue : graphicsQueue;
+	_queueFamily = _dedicated ? transferQueueFamily : graphicsQueueFamily;
+
+	VkCommandPoolCreateInfo poolInfo = vkinit::command_pool_create_info(_queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	VK_CHECK(vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool));
+
+	VkSemaphoreTypeCreateInfo timelineTypeInfo = vkinit::semaphore_type_create_info(VK_SEMAPHORE_TYPE_TIMELINE, 0);
+	VkSemaphoreCreateInfo timelineCreateInfo = vkinit::semaphore_create_info();
+	timelineCreateInfo.pNext = &timelineTypeInfo;
+	VK_CHECK(vkCreateSemaphore(_device, &timelineCreateInfo, nullptr, &_timeline));
+
+	_stagingRing.init(_allocator, memoryPools, STAGING_RING_SIZE);
+
+	_directUploadHeapSize = vkutil::get_direct_upload_heap_size(_allocator);
+
+	fmt::print("Upload Manager: {}, direct uploads {} ({:.0f} MB host visible device local)\n"
+		, _dedicated ? "dedicated transfer queue" : "graphics queue"
+		, supports_direct_upload() ? "supported" : "unsupported", _directUploadHeapSize / (1024.0 * 1024.0));
+}
+
+void UploadManager::destroy()
+{
+	// caller has waited for the device to go idle
+	for (Submission& submission : _inFlight) {
+		for (AllocatedBuffer& staging : submission.dedicatedStaging) {
+			vmaDestroyBuffer(_allocator, staging.buffer, staging.allocation);
+		}
+	}
+	_stagingRing.destroy();
+	_inFlight.clear();
+	_freeCommandBuffers.clear();
+	_pendingAcquires.clear();
+
+	vkDestroyCommandPool(_device, _commandPool, nullptr);
+	vkDestroySemaphore(_device, _timeline, nullptr);
+}
+
+UploadTicket UploadManager::upload_image(const AllocatedImage& image, const void* data, size_t dataSize, bool mipmapped)
+{
+	UploadBatch batch(*this);
+	batch.upload_image(image, data, dataSize, mipmapped);
+	return batch.submit();
+}
+
+UploadTicket UploadManager::upload_buffer(const AllocatedBuffer& buffer, const void* data, size_t dataSize, VkDeviceSize dstOffset)
+{
+	UploadBatch batch(*this);
+	batch.upload_buffer(buffer, data, dataSize, dstOffset);
+	return batch.submit();
+}
+
+UploadTicket UploadManager::copy_buffer(const AllocatedBuffer& src, const AllocatedBuffer& dst, VkDeviceSize size)
+{
+	UploadBatch batch(*this);
+	batch.copy_buffer(src, dst, size);
+	return batch.submit();
+}
+
+VmaAllocationCreateFlags UploadManager::get_device_buffer_flags() const
+{
+	if (!supports_direct_upload()) { return 0; }
+	// VMA falls back to memory the host can't see if the host visible heap is full, uploads are staged then
+	return VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT
+		| VMA_ALLOCATION_CREATE_MAPPED_BIT;
+}
+
+bool UploadManager::write_direct(const AllocatedBuffer& buffer, const void* data, size_t dataSize, VkDeviceSize dstOffset)
+{
+	VkMemoryPropertyFlags memoryFlags;
+	vmaGetAllocationMemoryProperties(_allocator, buffer.allocation, &memoryFlags);
+	if ((memoryFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0) { return false; }
+
+	// flushes non-coherent memory, the next queue submission makes the write visible to the device
+	VK_CHECK(vmaCopyMemoryToAllocation(_allocator, data, buffer.allocation, dstOffset, dataSize));
+	return true;
+}
+
+bool UploadManager::is_complete(UploadTicket ticket)
+{
+	uint64_t value;
+	VK_CHECK(vkGetSemaphoreCounterValue(_device, _timeline, &value));
+	return ticket <= value;
+}
+
+void UploadManager::wait(UploadTicket ticket, uint64_t timeout)
+{
+	VkSemaphoreWaitInfo waitInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.pNext = nullptr;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &_timeline;
+	waitInfo.pValues = &ticket;
+	VK_CHECK(vkWaitSemaphores(_device, &waitInfo, timeout));
+}
+
+uint64_t UploadManager::record_acquires(VkCommandBuffer cmd)
+{
+	if (_pendingAcquires.empty()) { return 0; }
+
+	uint64_t completed;
+	VK_CHECK(vkGetSemaphoreCounterValue(_device, _timeline, &completed));
+
+	// tickets are submitted in order, so the completed uploads are at the front
+	vkutil::BarrierBuilder barriers;
+	std::vector<PendingAcquire> mipmapped;
+	uint64_t waitValue = 0;
+	while (!_pendingAcquires.empty() && _pendingAcquires.front().ticket <= completed) {
+		PendingAcquire acquire = _pendingAcquires.front();
+		_pendingAcquires.pop_front();
+		waitValue = acquire.ticket;
+
+		// the semaphore wait alone makes the upload visible when the graphics queue did it
+		if (!_dedicated) { continue; }
+
+		if (acquire.image != VK_NULL_HANDLE) {
+			VkImageLayout layout = acquire.mipmapped ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			vkutil::LayoutSync dst = vkutil::get_dst_layout_sync(layout);
+			barriers.image(acquire.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, layout
+				, ACQUIRE_WAIT_STAGE, VK_ACCESS_2_NONE
+				, dst.stage, dst.access
+				, vkinit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT), _queueFamily, _graphicsQueueFamily);
+			if (acquire.mipmapped) { mipmapped.push_back(acquire); }
+		}
+		else {
+			barriers.buffer(acquire.buffer
+				, ACQUIRE_WAIT_STAGE, VK_ACCESS_2_NONE
+				, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT
+				, acquire.offset, acquire.size, _queueFamily, _graphicsQueueFamily);
+		}
+	}
+	barriers.flush(cmd);
+
+	for (const PendingAcquire& acquire : mipmapped) {
+		vkutil::generate_mipmaps(cmd, acquire.image, acquire.extent);
+	}
+
+	if (waitValue != 0) { _acquiredValue = waitValue; }
+	return waitValue;
+}
+
+void UploadManager::discard_acquires(VkBuffer buffer)
+{
+	std::erase_if(_pendingAcquires, [buffer](const PendingAcquire& acquire) { return acquire.buffer == buffer; });
+}
+
+VkCommandBuffer UploadManager::begin_commands()
+{
+	reclaim();
+
+	VkCommandBuffer cmd;
+	if (!_freeCommandBuffers.empty()) {
+		cmd = _freeCommandBuffers.back();
+		_freeCommandBuffers.pop_back();
+		VK_CHECK(vkResetCommandBuffer(cmd, 0));
+	}
+	else {
+		VkCommandBufferAllocateInfo allocInfo = vkinit::command_buffer_allocate_info(_commandPool);
+		VK_CHECK(vkAllocateCommandBuffers(_device, &allocInfo, &cmd));
+	}
+
+	VkCommandBufferBeginInfo beginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+	return cmd;
+}
+
+UploadTicket UploadManager::submit_batch(UploadBatch& batch)
+{
+	VkCommandBuffer cmd = begin_commands();
+	VkImageSubresourceRange range = vkinit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+	vkutil::BarrierBuilder barriers;
+
+	// upload targets are fresh images, nothing wrote them before
+	for (const UploadBatch::ImageUpload& upload : batch._images) {
+		barriers.image(upload.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+			, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE
+			, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, range);
+	}
+	barriers.flush(cmd);
+
+	for (const UploadBatch::ImageUpload& upload : batch._images) {
+		VkBufferImageCopy copyRegion = {};
+		copyRegion.bufferOffset = upload.staging.offset;
+		copyRegion.bufferRowLength = 0;
+		copyRegion.bufferImageHeight = 0;
+
+		copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copyRegion.imageSubresource.mipLevel = 0;
+		copyRegion.imageSubresource.baseArrayLayer = 0;
+		copyRegion.imageSubresource.layerCount = 1;
+		copyRegion.imageExtent = upload.extent;
+
+		vkCmdCopyBufferToImage(cmd, upload.staging.buffer, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+	}
+	for (const UploadBatch::BufferUpload& upload : batch._buffers) {
+		vkCmdCopyBuffer(cmd, upload.src, upload.dst, 1, &upload.region);
+	}
+
+	for (const UploadBatch::ImageUpload& upload : batch._images) {
+		VkExtent2D extent{ upload.extent.width, upload.extent.height };
+		if (!_dedicated) {
+			// graphics capable queue, the image is finished here
+			if (upload.mipmapped) { vkutil::generate_mipmaps(cmd, upload.image, extent); }
+			else { barriers.image(upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range); }
+		}
+		else {
+			// blits need a graphics queue, mipmapped images stay in TRANSFER_DST until they are acquired
+			VkImageLayout releaseLayout = upload.mipmapped ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barriers.image(upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, releaseLayout
+				, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT
+				, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE
+				, range, _queueFamily, _graphicsQueueFamily);
+		}
+	}
+	if (_dedicated) {
+		for (const UploadBatch::BufferUpload& upload : batch._buffers) {
+			barriers.buffer(upload.dst
+				, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT
+				, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE
+				, upload.region.dstOffset, upload.region.size, _queueFamily, _graphicsQueueFamily);
+		}
+	}
+	barriers.flush(cmd);
+
+	VK_CHECK(vkEndCommandBuffer(cmd));
+
+	UploadTicket ticket = ++_submittedValue;
+	VkCommandBufferSubmitInfo cmdInfo = vkinit::command_buffer_submit_info(cmd);
+	VkSemaphoreSubmitInfo signalInfo = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _timeline, ticket);
+	VkSubmitInfo2 submitInfo = vkinit::submit_info(&cmdInfo, &signalInfo, nullptr);
+	VK_CHECK(vkQueueSubmit2(_queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+	_stagingRing.submit(ticket);
+	_inFlight.push_back({ cmd, ticket, std::move(batch._dedicatedStaging) });
+
+	for (const UploadBatch::ImageUpload& upload : batch._images) {
+		_pendingAcquires.push_back({ ticket, upload.image, { upload.extent.width, upload.extent.height }, upload.mipmapped, VK_NULL_HANDLE, 0, 0 });
+	}
+	for (const UploadBatch::BufferUpload& upload : batch._buffers) {
+		_pendingAcquires.push_back({ ticket, VK_NULL_HANDLE, {}, false, upload.dst, upload.region.dstOffset, upload.region.size });
+	}
+	return ticket;
+}
+
+StagingAllocation UploadManager::stage(const void* data, size_t dataSize, VkDeviceSize alignment, std::vector<AllocatedBuffer>& dedicatedStaging)
+{
+	StagingAllocation staging{};
+	bool allocated = false;
+	if (dataSize <= MAX_RING_PAYLOAD) {
+		reclaim();
+		allocated = _stagingRing.allocate(dataSize, alignment, staging);
+		// the ring is full of in flight uploads, wait for the oldest one to retire
+		while (!allocated && !_inFlight.empty()) {
+			wait(_inFlight.front().ticket);
+			reclaim();
+			allocated = _stagingRing.allocate(dataSize, alignment, staging);
+		}
+	}
+
+	if (!allocated) {
+		VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.pNext = nullptr;
+		bufferInfo.size = dataSize;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+		VmaAllocationCreateInfo vmaallocInfo = {};
+		vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+		vmaallocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+		AllocatedBuffer buffer{};
+		VK_CHECK(_memoryPools->create_buffer(MemoryClass::Staging, bufferInfo, vmaallocInfo, buffer));
+		dedicatedStaging.push_back(buffer);
+		staging.buffer = buffer.buffer;
+		staging.offset = 0;
+		staging.mapped = buffer.info.pMappedData;
+	}
+
+	memcpy(staging.mapped, data, dataSize);
+	return staging;
+}
+
+void UploadManager::reclaim()
+{
+	if (_inFlight.empty()) { return; }
+
+	uint64_t completed;
+	VK_CHECK(vkGetSemaphoreCounterValue(_device, _timeline, &completed));
+	_stagingRing.reclaim(completed);
+	while (!_inFlight.empty() && _inFlight.front().ticket <= completed) {
+		Submission& submission = _inFlight.front();
+		for (AllocatedBuffer& staging : submission.dedicatedStaging) {
+			vmaDestroyBuffer(_allocator, staging.buffer, staging.allocation);
+		}
+		_freeCommandBuffers.push_back(submission.cmd);
+		_inFlight.pop_front();
+	}
+}
+
+UploadBatch::UploadBatch(UploadManager& manager)
+	: _manager(manager)
+{
+	if (_manager._batchOpen) {
+		fmt::print("Upload Manager: an upload batch is already open, submit it before starting another\n");
+		abort();
+	}
+	_manager._batchOpen = true;
+}
+
+UploadBatch::~UploadBatch()
+{
+	submit();
+}
+
+void UploadBatch::upload_image(const AllocatedImage& image, const void* data, size_t dataSize, bool mipmapped)
+{
+	// buffer offsets of image copies have to be a multiple of the texel size
+	VkExtent3D size = image.imageExtent;
+	VkDeviceSize texelSize = std::max<VkDeviceSize>(dataSize / (static_cast<VkDeviceSize>(size.width) * size.height * size.depth), 1);
+	StagingAllocation staging = _manager.stage(data, dataSize, std::lcm<VkDeviceSize>(16, texelSize), _dedicatedStaging);
+	_images.push_back({ image.image, size, mipmapped, staging });
+}
+
+void UploadBatch::upload_buffer(const AllocatedBuffer& buffer, const void* data, size_t dataSize, VkDeviceSize dstOffset)
+{
+	if (_manager.write_direct(buffer, data, dataSize, dstOffset)) { return; }
+
+	StagingAllocation staging = _manager.stage(data, dataSize, 16, _dedicatedStaging);
+
+	VkBufferCopy region{};
+	region.srcOffset = staging.offset;
+	region.dstOffset = dstOffset;
+	region.size = dataSize;
+	_buffers.push_back({ staging.buffer, buffer.buffer, region });
+}
+
+void UploadBatch::copy_buffer(const AllocatedBuffer& src, const AllocatedBuffer& dst, VkDeviceSize size)
+{
+	VkBufferCopy region{};
+	region.srcOffset = 0;
+	region.dstOffset = 0;
+	region.size = size;
+	_buffers.push_back({ src.buffer, dst.buffer, region });
+}
+
+UploadTicket UploadBatch::submit()
+{
+	if (_submitted) { return _ticket; }
+	_submitted = true;
+	_manager._batchOpen = false;
+
+	if (!_images.empty() || !_buffers.empty()) { _ticket = _manager.submit_batch(*this); }
+	return _ticket;
+}
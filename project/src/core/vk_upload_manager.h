@@ -0,0 +1,157 @@
+#pragma once
+#include "big_header.h"
+#include "vk_types.h"
+#include "vk_initializers.h"
+#include "vk_barriers.h"
+#include "vk_staging_ring.h"
+#include "vk_memory_pools.h"
+
+// value the upload timeline reaches once the upload has finished on the GPU, 0 is always complete
+using UploadTicket = uint64_t;
+
+class UploadBatch;
+
+// Asynchronous uploads on a dedicated transfer queue.
+//  Uploads are collected in an UploadBatch and submitted together, signaling the manager's timeline semaphore with the batch's ticket.
+//  With a dedicated transfer family the resources are released by that family, and record_acquires() acquires them
+//  on the graphics family once the upload has completed, so the frame never waits on a transfer in flight.
+//  Without one the uploads go through the graphics queue and no ownership transfer is needed.
+//  Payloads are staged in a persistently mapped ring, only oversized ones get a dedicated staging buffer.
+//  Buffers in host visible memory skip staging entirely: the payload is written into them directly and nothing is submitted.
+//  Upload targets must be freshly created resources that the graphics queue is not using.
+class UploadManager {
+public:
+	static constexpr VkDeviceSize STAGING_RING_SIZE = 64 * 1024 * 1024;
+	// larger payloads would hold a big share of the ring until they retire
+	static constexpr VkDeviceSize MAX_RING_PAYLOAD = STAGING_RING_SIZE / 4;
+	// host visible device local heaps up to this size are the BAR window of discrete GPUs without resizable BAR
+	static constexpr VkDeviceSize LEGACY_BAR_SIZE = vkutil::LEGACY_BAR_SIZE;
+
+	void init(VkDevice device, VmaAllocator allocator, MemoryPools& memoryPools
+		, VkQueue transferQueue, uint32_t transferQueueFamily
+		, VkQueue graphicsQueue, uint32_t graphicsQueueFamily);
+	void destroy();
+
+	// single uploads, each is a batch of one
+	UploadTicket upload_image(const AllocatedImage& image, const void* data, size_t dataSize, bool mipmapped);
+	UploadTicket upload_buffer(const AllocatedBuffer& buffer, const void* data, size_t dataSize, VkDeviceSize dstOffset = 0);
+	UploadTicket copy_buffer(const AllocatedBuffer& src, const AllocatedBuffer& dst, VkDeviceSize size);
+
+	bool is_complete(UploadTicket ticket);
+	void wait(UploadTicket ticket, uint64_t timeout = 1000000000);
+	// the resource has been acquired by a recorded graphics command buffer and can be used by later commands
+	bool is_acquired(UploadTicket ticket) const { return ticket <= _acquiredValue; }
+	// some upload hasn't been acquired by a recorded graphics command buffer yet
+	bool has_pending_acquires() const { return !_pendingAcquires.empty(); }
+
+	// records the graphics side of every completed upload (ownership acquire, mip generation) into cmd.
+	//  returns the timeline value the graphics submission has to wait on, 0 if nothing was acquired
+	uint64_t record_acquires(VkCommandBuffer cmd);
+	// forgets the acquires of a buffer destroyed before any graphics command used it, e.g. a benchmark target.
+	//  its uploads must have completed, a released resource can be destroyed without being acquired
+	void discard_acquires(VkBuffer buffer);
+	VkSemaphore get_timeline() const { return _timeline; }
+	bool has_dedicated_queue() const { return _dedicated; }
+
+	// device local memory the host can write to is large enough to place buffers in (resizable BAR, unified memory)
+	bool supports_direct_upload() const { return _directUploadHeapSize > LEGACY_BAR_SIZE; }
+	VkDeviceSize get_direct_upload_heap_size() const { return _directUploadHeapSize; }
+	// flags for device local buffers, when direct uploads are supported VMA may place them in host visible memory.
+	//  use with VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE and VK_BUFFER_USAGE_TRANSFER_DST_BIT for the staged fallback
+	VmaAllocationCreateFlags get_device_buffer_flags() const;
+
+private:
+	friend class UploadBatch;
+
+	struct Submission {
+		VkCommandBuffer cmd;
+		UploadTicket ticket;
+		// only for payloads that didn't go through the ring
+		std::vector<AllocatedBuffer> dedicatedStaging;
+	};
+
+	struct PendingAcquire {
+		UploadTicket ticket;
+		VkImage image;
+		VkExtent2D extent;
+		bool mipmapped;
+		VkBuffer buffer;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+
+	UploadTicket submit_batch(UploadBatch& batch);
+	VkCommandBuffer begin_commands();
+	// copies data into the ring, or into a new dedicated staging buffer if it's oversized or the ring can't make room
+	StagingAllocation stage(const void* data, size_t dataSize, VkDeviceSize alignment, std::vector<AllocatedBuffer>& dedicatedStaging);
+	// returns finished command buffers and staging memory
+	void reclaim();
+	// copies data straight into buffer if its memory is host visible, returns false if it has to be staged
+	bool write_direct(const AllocatedBuffer& buffer, const void* data, size_t dataSize, VkDeviceSize dstOffset);
+
+	VkDevice _device{ VK_NULL_HANDLE };
+	VmaAllocator _allocator{ VK_NULL_HANDLE };
+	MemoryPools* _memoryPools{ nullptr };
+	VkQueue _queue{ VK_NULL_HANDLE };
+	uint32_t _queueFamily{ 0 };
+	uint32_t _graphicsQueueFamily{ 0 };
+	bool _dedicated{ false };
+	VkDeviceSize _directUploadHeapSize{ 0 };
+
+	VkCommandPool _commandPool{ VK_NULL_HANDLE };
+	std::vector<VkCommandBuffer> _freeCommandBuffers;
+	std::deque<Submission> _inFlight;
+	StagingRing _stagingRing;
+	// ring allocations are grouped by submission, so only one batch can be collecting at a time
+	bool _batchOpen{ false };
+
+	VkSemaphore _timeline{ VK_NULL_HANDLE };
+	UploadTicket _submittedValue{ 0 };
+	UploadTicket _acquiredValue{ 0 };
+	std::deque<PendingAcquire> _pendingAcquires;
+};
+
+// Collects uploads and records them into one command buffer and one submission with consolidated barriers.
+//  Payloads are copied into staging memory immediately, so the source data doesn't have to outlive the call.
+//  Submits on destruction if submit() wasn't called.
+class UploadBatch {
+public:
+	explicit UploadBatch(UploadManager& manager);
+	~UploadBatch();
+
+	UploadBatch(const UploadBatch&) = delete;
+	UploadBatch& operator=(const UploadBatch&) = delete;
+
+	// image starts in VK_IMAGE_LAYOUT_UNDEFINED and ends in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL once acquired
+	void upload_image(const AllocatedImage& image, const void* data, size_t dataSize, bool mipmapped);
+	void upload_buffer(const AllocatedBuffer& buffer, const void* data, size_t dataSize, VkDeviceSize dstOffset = 0);
+	// buffers in host visible memory are written immediately and don't add to the batch
+	// src must stay alive until the batch's ticket completes
+	void copy_buffer(const AllocatedBuffer& src, const AllocatedBuffer& dst, VkDeviceSize size);
+
+	// returns the ticket of the batch, 0 if it was empty. later calls return the same ticket
+	UploadTicket submit();
+
+private:
+	friend class UploadManager;
+
+	struct ImageUpload {
+		VkImage image;
+		VkExtent3D extent;
+		bool mipmapped;
+		StagingAllocation staging;
+	};
+
+	struct BufferUpload {
+		VkBuffer src;
+		VkBuffer dst;
+		VkBufferCopy region;
+	};
+
+	UploadManager& _manager;
+	std::vector<ImageUpload> _images;
+	std::vector<BufferUpload> _buffers;
+	std::vector<AllocatedBuffer> _dedicatedStaging;
+	bool _submitted{ false };
+	UploadTicket _ticket{ 0 };
+};